@@ -0,0 +1,133 @@
+#include "batching_groupsock.hpp"
+
+#include <UsageEnvironment.hh>
+#include <netinet/in.h>
+#include <cstdio>
+
+// held datagrams go out at the latest after this long
+#define RTP_BATCH_DELAY_US 1000
+
+namespace
+{
+
+// all on the live555 thread
+ooknn::UdpBatch::Mode batch_mode = ooknn::UdpBatch::GSO;
+uint64_t total_datagrams = 0;
+uint64_t total_syscalls = 0;
+uint64_t total_errors = 0;
+// open sockets, and those of them still sending with GSO
+int open_sockets = 0;
+int gso_sockets = 0;
+
+}  // namespace
+
+BatchingGroupsock::BatchingGroupsock(UsageEnvironment &env, const struct sockaddr_storage &group, Port port, u_int8_t ttl)
+    : Groupsock(env, group, port, ttl)
+    , batch_(socketNum(), batch_mode)
+    , flush_task_(nullptr)
+    , last_ttl_(-1)
+    , accounted_datagrams_(0)
+    , accounted_syscalls_(0)
+    , accounted_errors_(0)
+    , gso_(batch_.ActiveMode() == ooknn::UdpBatch::GSO)
+{
+    ++open_sockets;
+    gso_sockets += gso_;
+}
+
+BatchingGroupsock::~BatchingGroupsock()
+{
+    env().taskScheduler().unscheduleDelayedTask(flush_task_);
+    Flush();
+    --open_sockets;
+    gso_sockets -= gso_;
+}
+
+void BatchingGroupsock::SetMode(ooknn::UdpBatch::Mode mode)
+{
+    batch_mode = mode;
+}
+
+std::string BatchingGroupsock::Summary()
+{
+    char mode[64];
+    if (batch_mode == ooknn::UdpBatch::SENDTO)
+    {
+        snprintf(mode, sizeof(mode), "sendto");
+    }
+    else
+    {
+        // GSO is probed and can be dropped per socket
+        snprintf(mode, sizeof(mode), "sendmmsg, gso on %d of %d sockets", gso_sockets, open_sockets);
+    }
+    char line[200];
+    snprintf(line, sizeof(line), "rtp %llu datagrams in %llu send calls (%.1f per call, %s), %llu send errors",
+             static_cast<unsigned long long>(total_datagrams), static_cast<unsigned long long>(total_syscalls),
+             total_syscalls ? static_cast<double>(total_datagrams) / static_cast<double>(total_syscalls) : 0.0,
+             mode, static_cast<unsigned long long>(total_errors));
+    total_datagrams = 0;
+    total_syscalls = 0;
+    total_errors = 0;
+    return line;
+}
+
+Boolean BatchingGroupsock::write(const struct sockaddr_storage &destination, u_int8_t ttl, unsigned char *buffer, unsigned size)
+{
+    if (ttl != last_ttl_)
+    {
+        // only matters for multicast destinations, as in OutputSocket::write
+        int hops = ttl;
+        if (destination.ss_family == AF_INET6)
+        {
+            setsockopt(socketNum(), IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+        }
+        else
+        {
+            u_int8_t ttl4 = ttl;
+            setsockopt(socketNum(), IPPROTO_IP, IP_MULTICAST_TTL, &ttl4, sizeof(ttl4));
+        }
+        last_ttl_ = ttl;
+    }
+
+    bool ok = batch_.Add(destination, buffer, size);
+    if (size > 1 && (buffer[1] & 0x80))
+    {
+        env().taskScheduler().unscheduleDelayedTask(flush_task_);
+        ok = batch_.Flush() && ok;
+    }
+    else if (!flush_task_ && !batch_.Empty())
+    {
+        flush_task_ = env().taskScheduler().scheduleDelayedTask(RTP_BATCH_DELAY_US, Flush0, this);
+    }
+    Account();
+    return ok;
+}
+
+void BatchingGroupsock::Flush0(void *clientData)
+{
+    auto self = static_cast<BatchingGroupsock *>(clientData);
+    self->flush_task_ = nullptr;
+    self->Flush();
+}
+
+void BatchingGroupsock::Flush()
+{
+    batch_.Flush();
+    Account();
+}
+
+void BatchingGroupsock::Account()
+{
+    total_datagrams += batch_.Datagrams() - accounted_datagrams_;
+    total_syscalls += batch_.Syscalls() - accounted_syscalls_;
+    total_errors += batch_.Errors() - accounted_errors_;
+    accounted_datagrams_ = batch_.Datagrams();
+    accounted_syscalls_ = batch_.Syscalls();
+    accounted_errors_ = batch_.Errors();
+    // a socket falls back from GSO for good, never the other way
+    if (gso_ && batch_.ActiveMode() != ooknn::UdpBatch::GSO)
+    {
+        gso_ = false;
+        --gso_sockets;
+    }
+}
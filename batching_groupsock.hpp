@@ -0,0 +1,47 @@
+#ifndef __BATCHING_GROUPSOCK_HPP__
+#define __BATCHING_GROUPSOCK_HPP__
+
+#include "udp_batch.hpp"
+#include <Groupsock.hh>
+#include <cstdint>
+#include <string>
+
+// Groupsock whose datagrams are held back until the end of the access unit
+// and then leave in one ooknn::UdpBatch flush. MultiFramedRTPSink sends the
+// packets of a frame back to back, so an IDR of hundreds of packets costs one
+// sendmmsg instead of hundreds of sendto calls. A packet with the RTP marker
+// bit ends the access unit; RTCP packets have that bit set in their packet
+// type and go out at once. Anything still held after a millisecond is sent
+// by a timer.
+class BatchingGroupsock : public Groupsock
+{
+public:
+    BatchingGroupsock(UsageEnvironment &env, const struct sockaddr_storage &group, Port port, u_int8_t ttl);
+    ~BatchingGroupsock() override;
+
+    Boolean write(const struct sockaddr_storage &destination, u_int8_t ttl, unsigned char *buffer, unsigned size) override;
+
+    // upper bound for every socket created afterwards, from rtp_send
+    static void SetMode(ooknn::UdpBatch::Mode mode);
+    // datagrams, syscalls and send errors of all sockets since the previous
+    // call, and how many of the open sockets send with GSO
+    static std::string Summary();
+
+private:
+    static void Flush0(void *clientData);
+    void Flush();
+    // adds what the batch sent since the last call to the totals of Summary
+    void Account();
+
+private:
+    ooknn::UdpBatch batch_;
+    TaskToken flush_task_;
+    int last_ttl_;
+    uint64_t accounted_datagrams_;
+    uint64_t accounted_syscalls_;
+    uint64_t accounted_errors_;
+    // counted in the GSO sockets of Summary
+    bool gso_;
+};
+
+#endif  // __BATCHING_GROUPSOCK_HPP__
@@ -0,0 +1,111 @@
+#include "broadcast_ring.hpp"
+#include "nal_splitter.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <climits>
+
+BroadcastRing::BroadcastRing(VideoCodec codec, size_t slots, size_t max_bytes)
+    : codec_(codec)
+    , entries_(slots)
+    , max_bytes_(max_bytes)
+    , head_(0)
+    , tail_(0)
+    , bytes_(0)
+    , last_pts_(INT64_MIN)
+{
+    assert(slots > 0);
+}
+
+void BroadcastRing::Evict()
+{
+    Entry &entry = entries_[tail_ % entries_.size()];
+    bytes_ -= entry.nal.Size();
+    entry.nal.Reset();
+    ++tail_;
+    while (!key_frames_.empty() && key_frames_.front() < tail_)
+    {
+        key_frames_.pop_front();
+    }
+}
+
+void BroadcastRing::Push(PacketView &&nal, int64_t now)
+{
+    if (nal.Empty())
+    {
+        return;
+    }
+
+    NalKind kind = KindOfNal(codec_, nal.Data());
+    if (kind == NalKind::Vps)
+    {
+        vps_ = nal;
+    }
+    else if (kind == NalKind::Sps)
+    {
+        sps_ = nal;
+    }
+    else if (kind == NalKind::Pps)
+    {
+        pps_ = nal;
+    }
+
+    while (tail_ < head_ && (head_ - tail_ >= entries_.size() || bytes_ + nal.Size() > max_bytes_))
+    {
+        Evict();
+    }
+    if (nal.KeyFrame() && nal.Pts() != last_pts_)
+    {
+        key_frames_.push_back(head_);
+    }
+    last_pts_ = nal.Pts();
+    bytes_ += nal.Size();
+    entries_[head_ % entries_.size()] = Entry {std::move(nal), now};
+    ++head_;
+}
+
+const PacketView &BroadcastRing::At(uint64_t seq) const
+{
+    return entries_[seq % entries_.size()].nal;
+}
+
+int64_t BroadcastRing::PushedAt(uint64_t seq) const
+{
+    return entries_[seq % entries_.size()].pushed;
+}
+
+uint64_t BroadcastRing::NextKeyFrame(uint64_t seq) const
+{
+    auto it = std::lower_bound(key_frames_.begin(), key_frames_.end(), seq);
+    return it == key_frames_.end() ? head_ : *it;
+}
+
+uint64_t BroadcastRing::LastKeyFrame() const
+{
+    return key_frames_.empty() ? head_ : key_frames_.back();
+}
+
+bool BroadcastRing::HasParameterSets(uint64_t seq) const
+{
+    for (uint64_t i = seq; i < head_ && At(i).Pts() == At(seq).Pts(); ++i)
+    {
+        if (KindOfNal(codec_, At(i).Data()) == NalKind::Sps)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<PacketView> BroadcastRing::ParameterSets() const
+{
+    if (sps_.Empty() || pps_.Empty() || (codec_ == VideoCodec::H265 && vps_.Empty()))
+    {
+        return {};
+    }
+    if (codec_ == VideoCodec::H265)
+    {
+        return {vps_, sps_, pps_};
+    }
+    return {sps_, pps_};
+}
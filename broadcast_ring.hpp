@@ -0,0 +1,74 @@
+#ifndef __BROADCAST_RING_HPP__
+#define __BROADCAST_RING_HPP__
+
+#include "nal_splitter.hpp"
+#include "packet_view.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The encoded NALs of one rendition, written once and read by every client
+// through its own cursor. Entries are PacketViews, so each NAL is a refcount
+// on the encoder's buffer however many clients read it.
+//
+// NALs are addressed by a sequence number that only grows; Tail() is the
+// oldest one still held, Head() the next one to be written. The writer evicts
+// from the tail when the ring runs out of slots or bytes and never waits for a
+// reader: a reader whose cursor fell behind Tail() lost those NALs and has to
+// resume at a key frame. Not thread safe, writer and readers all run on the
+// live555 thread.
+class BroadcastRing
+{
+public:
+    BroadcastRing(VideoCodec codec, size_t slots, size_t max_bytes);
+    BroadcastRing(const BroadcastRing &) = delete;
+    BroadcastRing &operator=(const BroadcastRing &) = delete;
+
+    // appends a NAL that reached the live555 thread at `now` (av_gettime)
+    void Push(PacketView &&nal, int64_t now);
+
+    uint64_t Head() const { return head_; }
+    uint64_t Tail() const { return tail_; }
+    // Tail() <= seq < Head()
+    const PacketView &At(uint64_t seq) const;
+    int64_t PushedAt(uint64_t seq) const;
+
+    // first NAL of the first IDR access unit at or after `seq`, Head() if none is held
+    uint64_t NextKeyFrame(uint64_t seq) const;
+    // first NAL of the newest IDR access unit, Head() if none is held
+    uint64_t LastKeyFrame() const;
+    // whether the access unit starting at `seq` carries an SPS
+    bool HasParameterSets(uint64_t seq) const;
+    // latest VPS (H.265 only), SPS and PPS in decoding order, empty until all were seen
+    std::vector<PacketView> ParameterSets() const;
+    VideoCodec Codec() const { return codec_; }
+
+    size_t Size() const { return static_cast<size_t>(head_ - tail_); }
+    size_t Bytes() const { return bytes_; }
+
+private:
+    struct Entry
+    {
+        PacketView nal;
+        int64_t pushed;
+    };
+
+    void Evict();
+
+private:
+    VideoCodec codec_;
+    std::vector<Entry> entries_;
+    size_t max_bytes_;
+    uint64_t head_;
+    uint64_t tail_;
+    size_t bytes_;
+    int64_t last_pts_;
+    // sequence numbers of the IDR access units held, oldest first
+    std::deque<uint64_t> key_frames_;
+    PacketView vps_;
+    PacketView sps_;
+    PacketView pps_;
+};
+
+#endif  // __BROADCAST_RING_HPP__
@@ -0,0 +1,12 @@
+#include "capture_source.hpp"
+#include "demuxer_source.hpp"
+#include "shm_source.hpp"
+
+std::unique_ptr<CaptureSource> CaptureSource::Create(const StreamConfig &stream)
+{
+    if (stream.input_format == "shm")
+    {
+        return std::make_unique<ShmSource>(stream);
+    }
+    return std::make_unique<DemuxerSource>(stream);
+}
@@ -0,0 +1,43 @@
+#ifndef __CAPTURE_SOURCE_HPP__
+#define __CAPTURE_SOURCE_HPP__
+
+#include "config.hpp"
+#include <cstdint>
+#include <memory>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libavutil/rational.h>
+}
+#endif
+
+struct AVFrame;
+
+// Where a RecordCodec gets its pictures from. Implementations hand out
+// decoded frames and their properties; the codec does not know whether they
+// came from a demuxer or from another process.
+class CaptureSource
+{
+public:
+    virtual ~CaptureSource() = default;
+
+    // Picks the implementation from stream.input_format: "shm" opens the
+    // shared memory ring named by stream.input, anything else is a libavformat
+    // input (x11grab, v4l2, lavfi, a file, ...).
+    static std::unique_ptr<CaptureSource> Create(const StreamConfig &stream);
+
+    // Fills `frame` with a reference to the next picture, pts in TimeBase(),
+    // and `captured` with its capture wallclock (av_gettime). Returns 1 for a
+    // frame, 0 if none is available yet and a negative AVERROR at the end.
+    virtual int Read(AVFrame *frame, int64_t &captured) = 0;
+
+    virtual int Width() const = 0;
+    virtual int Height() const = 0;
+    virtual AVPixelFormat Format() const = 0;
+    virtual AVRational FrameRate() const = 0;
+    virtual AVRational TimeBase() const = 0;
+    virtual AVRational SampleAspectRatio() const = 0;
+};
+
+#endif  // __CAPTURE_SOURCE_HPP__
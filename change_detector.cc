@@ -0,0 +1,155 @@
+#include "change_detector.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+#endif
+
+#include <immintrin.h>
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+inline uint64_t Load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t HashC(uint64_t h, const uint8_t *p, size_t n)
+{
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        h = (h ^ Load64(p)) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    for (; n; ++p, --n)
+    {
+        h = (h ^ *p) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+// Two independent CRC32C chains in the low and high half of the state, so the
+// three cycle latency of crc32 is overlapped.
+__attribute__((target("sse4.2"))) uint64_t HashSSE42(uint64_t h, const uint8_t *p, size_t n)
+{
+    uint64_t a = static_cast<uint32_t>(h);
+    uint64_t b = h >> 32;
+    for (; n >= 16; p += 16, n -= 16)
+    {
+        a = _mm_crc32_u64(a, Load64(p));
+        b = _mm_crc32_u64(b, Load64(p + 8));
+    }
+    if (n >= 8)
+    {
+        a = _mm_crc32_u64(a, Load64(p));
+        p += 8;
+        n -= 8;
+    }
+    uint32_t tail = static_cast<uint32_t>(b);
+    for (; n; ++p, --n)
+    {
+        tail = _mm_crc32_u8(tail, *p);
+    }
+    return (static_cast<uint64_t>(tail) << 32) | static_cast<uint32_t>(a);
+}
+
+}  // namespace
+
+ChangeDetector::ChangeDetector(int width, int height, AVPixelFormat format)
+    : width_(width)
+    , height_(height)
+    , columns_((width + TILE - 1) / TILE)
+    , rows_((height + TILE - 1) / TILE)
+    , hashes_(static_cast<size_t>(columns_) * static_cast<size_t>(rows_), 0)
+    , row_(static_cast<size_t>(columns_), 0)
+    , primed_(false)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    assert(desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL));
+
+    int linesizes[4] = {0};
+    int status = av_image_fill_linesizes(linesizes, format, width);
+    assert(status >= 0);
+
+    // every plane is split along the same tile grid, scaled by its subsampling
+    int count = av_pix_fmt_count_planes(format);
+    for (int i = 0; i < count; ++i)
+    {
+        bool chroma = (i == 1 || i == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        Plane plane;
+        plane.height = chroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        plane.tile_height = chroma ? TILE >> desc->log2_chroma_h : TILE;
+        for (int c = 0; c <= columns_; ++c)
+        {
+            int x = std::min(c * TILE, width);
+            plane.columns.push_back(static_cast<size_t>(static_cast<int64_t>(x) * linesizes[i] / width));
+        }
+        planes_.push_back(std::move(plane));
+    }
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        hash_ = HashSSE42;
+        kernel_name_ = "crc32c-sse4.2";
+    }
+    else
+    {
+        hash_ = HashC;
+        kernel_name_ = "c";
+    }
+}
+
+size_t ChangeDetector::Update(const AVFrame *frame)
+{
+    assert(frame->width == width_ && frame->height == height_);
+
+    size_t changed = 0;
+    for (int r = 0; r < rows_; ++r)
+    {
+        std::fill(row_.begin(), row_.end(), 0);
+        // rows are walked whole, so memory is read sequentially
+        for (size_t i = 0; i < planes_.size(); ++i)
+        {
+            const Plane &plane = planes_[i];
+            int y_end = std::min((r + 1) * plane.tile_height, plane.height);
+            for (int y = r * plane.tile_height; y < y_end; ++y)
+            {
+                const uint8_t *line = frame->data[i] + static_cast<ptrdiff_t>(y) * frame->linesize[i];
+                for (int c = 0; c < columns_; ++c)
+                {
+                    row_[c] = hash_(row_[c], line + plane.columns[c], plane.columns[c + 1] - plane.columns[c]);
+                }
+            }
+        }
+
+        uint64_t *stored = hashes_.data() + static_cast<size_t>(r) * static_cast<size_t>(columns_);
+        for (int c = 0; c < columns_; ++c)
+        {
+            changed += !primed_ || stored[c] != row_[c];
+            stored[c] = row_[c];
+        }
+    }
+    primed_ = true;
+    return changed;
+}
+
+size_t ChangeDetector::Tiles() const
+{
+    return hashes_.size();
+}
+
+const char *ChangeDetector::Kernel() const
+{
+    return kernel_name_;
+}
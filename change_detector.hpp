@@ -0,0 +1,58 @@
+#ifndef __CHANGE_DETECTOR_HPP__
+#define __CHANGE_DETECTOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+struct AVFrame;
+
+// Finds which TILE x TILE blocks of a picture changed since the previous one
+// by keeping a 64-bit checksum per tile. Works on the raw captured frame, so an
+// unchanged screen can be recognized before any conversion or encoding is paid.
+class ChangeDetector
+{
+public:
+    static constexpr int TILE = 64;
+
+    ChangeDetector(int width, int height, AVPixelFormat format);
+    ChangeDetector(const ChangeDetector &) = delete;
+    ChangeDetector &operator=(const ChangeDetector &) = delete;
+
+    // Hashes every tile of `frame` and returns how many differ from the last
+    // call; the first call reports all of them.
+    size_t Update(const AVFrame *frame);
+    size_t Tiles() const;
+    // checksum implementation chosen for this CPU
+    const char *Kernel() const;
+
+private:
+    using HashKernel = uint64_t (*)(uint64_t seed, const uint8_t *data, size_t size);
+
+    struct Plane
+    {
+        int height;
+        int tile_height;
+        // byte offset of every tile column in a row, columns + 1 entries
+        std::vector<size_t> columns;
+    };
+
+    int width_;
+    int height_;
+    int columns_;
+    int rows_;
+    std::vector<Plane> planes_;
+    std::vector<uint64_t> hashes_;
+    std::vector<uint64_t> row_;
+    bool primed_;
+    HashKernel hash_;
+    const char *kernel_name_;
+};
+
+#endif  // __CHANGE_DETECTOR_HPP__
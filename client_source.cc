@@ -0,0 +1,216 @@
+#include "client_source.hpp"
+#include "broadcast_ring.hpp"
+#include "config.hpp"
+#include "frame_source.hpp"
+#include "nal_splitter.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/time.h>
+}
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+ClientFrameSource *ClientFrameSource::createNew(UsageEnvironment &env, RecordFrameSource *stream)
+{
+    return new ClientFrameSource(env, stream);
+}
+
+ClientFrameSource::ClientFrameSource(UsageEnvironment &env, RecordFrameSource *stream)
+    : FramedSource(env)
+    , stream_(stream)
+    , latency_budget_us_(static_cast<int64_t>(stream->Stream().latency_budget_ms) * 1000)
+    , speed_(stream->Stream().gop_cache_speed)
+    , started_(false)
+    , started_at_(0)
+    , primed_(false)
+    , joined_(false)
+    , cursor_(0)
+    , waiting_key_(false)
+    , lagging_(false)
+    , key_requested_(false)
+    , allowance_us_(0)
+    , next_preamble_(0)
+{
+    stream_->AddClient(this);
+}
+
+ClientFrameSource::~ClientFrameSource()
+{
+    stream_->RemoveClient(this);
+}
+
+void ClientFrameSource::OnData()
+{
+    if (isCurrentlyAwaitingData())
+    {
+        Deliver();
+    }
+}
+
+void ClientFrameSource::doGetNextFrame()
+{
+    if (!started_)
+    {
+        Join();
+    }
+    Deliver();
+}
+
+void ClientFrameSource::doStopGettingFrames()
+{
+    // a paused client resumes at an IDR
+    waiting_key_ = true;
+    lagging_ = false;
+    preamble_.clear();
+    next_preamble_ = 0;
+    FramedSource::doStopGettingFrames();
+}
+
+void ClientFrameSource::Join()
+{
+    const BroadcastRing &ring = stream_->Ring();
+    started_ = true;
+    started_at_ = av_gettime();
+    uint64_t key = ring.LastKeyFrame();
+    if (stream_->Stream().gop_cache && key != ring.Head())
+    {
+        primed_ = true;
+        allowance_us_ = started_at_ - ring.PushedAt(key);
+        StartAt(key);
+    }
+    else
+    {
+        cursor_ = ring.Head();
+        waiting_key_ = true;
+    }
+}
+
+bool ClientFrameSource::Lagging(const BroadcastRing &ring, int64_t now) const
+{
+    return cursor_ < ring.Tail() || (cursor_ < ring.Head() && now - ring.PushedAt(cursor_) > latency_budget_us_ + allowance_us_);
+}
+
+void ClientFrameSource::StartAt(uint64_t seq)
+{
+    const BroadcastRing &ring = stream_->Ring();
+    cursor_ = seq;
+    waiting_key_ = false;
+    lagging_ = false;
+    key_requested_ = false;
+    preamble_.clear();
+    next_preamble_ = 0;
+    // x264 and x265 repeat the parameter sets on every IDR, other encoders may not
+    if (!ring.HasParameterSets(seq))
+    {
+        preamble_ = ring.ParameterSets();
+    }
+}
+
+void ClientFrameSource::CountSkipped(uint64_t from, uint64_t to)
+{
+    const BroadcastRing &ring = stream_->Ring();
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    for (uint64_t seq = std::max(from, ring.Tail()); seq < to; ++seq)
+    {
+        // frames are counted by presentation timestamp, one AU may span several NALs
+        if (seq == ring.Tail() || ring.At(seq).Pts() != ring.At(seq - 1).Pts())
+        {
+            ++frames;
+        }
+        bytes += ring.At(seq).Size();
+    }
+    stream_->CountDropped(frames, bytes);
+}
+
+void ClientFrameSource::Deliver()
+{
+    const BroadcastRing &ring = stream_->Ring();
+    if (next_preamble_ == preamble_.size())
+    {
+        int64_t now = av_gettime();
+        if (!waiting_key_ && Lagging(ring, now))
+        {
+            std::cout << stream_->Name() << ": client fell " << (now - ring.PushedAt(std::max(cursor_, ring.Tail()))) / 1000
+                      << " ms behind, skipping to the next IDR" << std::endl;
+            waiting_key_ = true;
+            lagging_ = true;
+            allowance_us_ = 0;
+        }
+        if (waiting_key_)
+        {
+            uint64_t key = ring.NextKeyFrame(std::max(cursor_, ring.Tail()));
+            if (lagging_)
+            {
+                CountSkipped(cursor_, key);
+            }
+            if (key == ring.Head())
+            {
+                cursor_ = key;
+                if (!key_requested_)
+                {
+                    // nothing decodable is coming soon, do not wait a whole GOP
+                    stream_->RequestKeyFrame();
+                    key_requested_ = true;
+                }
+                return;
+            }
+            StartAt(key);
+        }
+    }
+
+    if (next_preamble_ < preamble_.size())
+    {
+        Send(preamble_[next_preamble_++], 0);
+        return;
+    }
+    if (cursor_ == ring.Head())
+    {
+        // caught up, OnData delivers the next one
+        allowance_us_ = 0;
+        return;
+    }
+
+    uint64_t seq = cursor_++;
+    const PacketView &nal = ring.At(seq);
+    unsigned duration = 0;
+    if (allowance_us_ && speed_ > 0 && cursor_ < ring.Head() && ring.At(cursor_).Time() > nal.Time())
+    {
+        // catching up at a multiple of real time, the sink waits this long before the next request
+        duration = static_cast<unsigned>((ring.At(cursor_).Time() - nal.Time()) / speed_);
+    }
+    Send(nal, duration);
+}
+
+void ClientFrameSource::Send(const PacketView &nal, unsigned duration)
+{
+    fFrameSize = static_cast<unsigned>(std::min<size_t>(nal.Size(), fMaxSize));
+    fNumTruncatedBytes = static_cast<unsigned>(nal.Size() - fFrameSize);
+    if (fNumTruncatedBytes)
+    {
+        std::cout << "Exceeded max size, truncated: " << fNumTruncatedBytes << ", size: " << nal.Size() << "\n";
+    }
+    if (nal.Time())
+    {
+        fPresentationTime.tv_sec = static_cast<time_t>(nal.Time() / 1000000);
+        fPresentationTime.tv_usec = static_cast<suseconds_t>(nal.Time() % 1000000);
+    }
+    else
+    {
+        gettimeofday(&fPresentationTime, nullptr);
+    }
+    fDurationInMicroseconds = duration;
+    // the only copy of the payload: straight from the encoder's packet buffer into this client's sink
+    memcpy(fTo, nal.Data(), fFrameSize);
+
+    if (!joined_ && KindOfNal(stream_->Ring().Codec(), nal.Data()) == NalKind::KeySlice)
+    {
+        joined_ = true;
+        stream_->RecordJoin(av_gettime() - started_at_, primed_);
+    }
+    FramedSource::afterGetting(this);
+}
@@ -0,0 +1,69 @@
+#ifndef __CLIENT_SOURCE_HPP__
+#define __CLIENT_SOURCE_HPP__
+
+#include "packet_view.hpp"
+#include <FramedSource.hh>
+#include <cstdint>
+#include <vector>
+
+class BroadcastRing;
+class RecordFrameSource;
+
+// One RTSP client's view of a RecordFrameSource: a cursor into the rendition's
+// BroadcastRing. NALs go from the encoder's buffer straight into the sink's
+// buffer, there is no per-client queue.
+//
+// A new client starts at the newest IDR in the ring when gop_cache is on
+// (parameter sets first if that access unit lacks them) and sends the rest
+// of the GOP as fast as the sink takes it, or at gop_cache_speed times real
+// time. Otherwise it waits for the next IDR and asks the encoder for one.
+// A client whose next NAL has been in the ring longer than latency_budget_ms
+// (beyond the backlog it started with) or was evicted already skips ahead to
+// the next IDR.
+class ClientFrameSource : public FramedSource
+{
+public:
+    static ClientFrameSource *createNew(UsageEnvironment &env, RecordFrameSource *stream);
+
+    // new NALs are in the ring
+    void OnData();
+
+protected:
+    ClientFrameSource(UsageEnvironment &env, RecordFrameSource *stream);
+    ~ClientFrameSource() override;
+    void doGetNextFrame() override;
+    void doStopGettingFrames() override;
+
+private:
+    void Join();
+    void Deliver();
+    bool Lagging(const BroadcastRing &ring, int64_t now) const;
+    void StartAt(uint64_t seq);
+    // counts the frames in [from, to) a slow client never got
+    void CountSkipped(uint64_t from, uint64_t to);
+    void Send(const PacketView &nal, unsigned duration);
+
+private:
+    RecordFrameSource *stream_;
+    int64_t latency_budget_us_;
+    int speed_;
+
+    bool started_;
+    int64_t started_at_;
+    bool primed_;
+    bool joined_;
+
+    // next NAL to send
+    uint64_t cursor_;
+    // skip to the next IDR, because of a cold start or a slow client
+    bool waiting_key_;
+    bool lagging_;
+    bool key_requested_;
+    // age of the first NAL at join, tolerated until the client caught up
+    int64_t allowance_us_;
+    // parameter sets for an IDR access unit that came without them
+    std::vector<PacketView> preamble_;
+    size_t next_preamble_;
+};
+
+#endif  // __CLIENT_SOURCE_HPP__
@@ -0,0 +1,217 @@
+#include "clip_ring.hpp"
+#include "nal_splitter.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+#endif
+
+#include <unistd.h>
+#include <assert.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+ClipRing::ClipRing(size_t bytes, int max_seconds, const AVCodecParameters *parameters, AVRational time_base)
+    : arena_(nullptr)
+    , capacity_(bytes)
+    , max_us_(static_cast<int64_t>(max_seconds) * 1000000)
+    , parameters_(avcodec_parameters_alloc())
+    , time_base_(time_base)
+    , head_(0)
+    , waiting_key_(true)
+    , tail_(0)
+{
+    int statCode = posix_memalign(reinterpret_cast<void **>(&arena_), 4096, capacity_);
+    assert(statCode == 0);
+    // fault every page in now rather than on the encode strand
+    memset(arena_, 0, capacity_);
+    statCode = avcodec_parameters_copy(parameters_, parameters);
+    assert(statCode >= 0);
+}
+
+ClipRing::~ClipRing()
+{
+    avcodec_parameters_free(&parameters_);
+    free(arena_);
+}
+
+void ClipRing::EvictGop()
+{
+    size_t count = gops_.front();
+    gops_.pop_front();
+    entries_.erase(entries_.begin(), entries_.begin() + static_cast<std::ptrdiff_t>(count));
+}
+
+void ClipRing::Append(const AVPacket *packet, int64_t captured)
+{
+    bool key = packet->flags & AV_PKT_FLAG_KEY;
+    size_t size = static_cast<size_t>(packet->size);
+    if (size == 0 || (waiting_key_ && !key))
+    {
+        return;
+    }
+
+    // a packet never wraps around the end of the arena
+    uint64_t pos = head_;
+    size_t offset = static_cast<size_t>(pos % capacity_);
+    if (offset + size > capacity_)
+    {
+        pos += capacity_ - offset;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a GOP that alone outgrows the arena is evicted as well
+        while (!entries_.empty() && pos + size - entries_.front().pos > capacity_)
+        {
+            EvictGop();
+        }
+        // the oldest GOP goes once the following ones cover the window by themselves
+        while (gops_.size() > 1 && captured - entries_[gops_.front()].captured >= max_us_)
+        {
+            EvictGop();
+        }
+        if (size > capacity_ || (entries_.empty() && !key))
+        {
+            waiting_key_ = true;
+            return;
+        }
+        tail_.store(entries_.empty() ? pos : entries_.front().pos, std::memory_order_relaxed);
+    }
+    // readers that see any of the new bytes also see the tail that moved past their packet
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(arena_ + pos % capacity_, packet->data, size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(Entry {pos, static_cast<uint32_t>(size), key, packet->pts, packet->dts, captured});
+    if (key)
+    {
+        gops_.push_back(1);
+    }
+    else
+    {
+        ++gops_.back();
+    }
+    head_ = pos + size;
+    waiting_key_ = false;
+}
+
+bool ClipRing::Export(const std::string &path, int64_t from, int64_t to)
+{
+    std::vector<Entry> clip;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t start = 0;
+        for (size_t i = 0; i < entries_.size() && entries_[i].captured <= from; ++i)
+        {
+            start = entries_[i].key ? i : start;
+        }
+        for (size_t i = start; i < entries_.size() && entries_[i].captured <= to; ++i)
+        {
+            clip.push_back(entries_[i]);
+        }
+    }
+    if (clip.empty())
+    {
+        return false;
+    }
+
+    AVFormatContext *format_ctx = nullptr;
+    int statCode = avformat_alloc_output_context2(&format_ctx, nullptr, "mp4", path.c_str());
+    assert(statCode >= 0);
+    if (avio_open(&format_ctx->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+    {
+        std::cout << "cannot open " << path << std::endl;
+        avformat_free_context(format_ctx);
+        return false;
+    }
+    AVStream *stream = avformat_new_stream(format_ctx, nullptr);
+    avcodec_parameters_copy(stream->codecpar, parameters_);
+    stream->codecpar->codec_tag = 0;
+    stream->time_base = time_base_;
+
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> extradata;
+    AVPacket *packet = av_packet_alloc();
+    bool started = false;
+    bool skipping = false;
+    int64_t offset = 0;
+    for (const auto &entry : clip)
+    {
+        data.resize(entry.size + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(data.data(), arena_ + entry.pos % capacity_, entry.size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // overwritten while copying: resume at the next key frame still in the ring
+        if (tail_.load(std::memory_order_relaxed) > entry.pos)
+        {
+            skipping = true;
+            continue;
+        }
+        if (skipping && !entry.key)
+        {
+            continue;
+        }
+        skipping = false;
+
+        if (!started)
+        {
+            // parameter sets are repeated in band on key frames, MP4 wants them in the header
+            VideoCodec codec = parameters_->codec_id == AV_CODEC_ID_HEVC ? VideoCodec::H265 : VideoCodec::H264;
+            if (ExtractParameterSets(codec, data.data(), entry.size, extradata))
+            {
+                stream->codecpar->extradata = static_cast<uint8_t *>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+                memcpy(stream->codecpar->extradata, extradata.data(), extradata.size());
+                stream->codecpar->extradata_size = static_cast<int>(extradata.size());
+            }
+            if (avformat_write_header(format_ctx, nullptr) < 0)
+            {
+                break;
+            }
+            offset = entry.dts;
+            started = true;
+        }
+
+        packet->data = data.data();
+        packet->size = static_cast<int>(entry.size);
+        packet->flags = entry.key ? AV_PKT_FLAG_KEY : 0;
+        packet->stream_index = 0;
+        packet->pts = entry.pts - offset;
+        packet->dts = entry.dts - offset;
+        av_packet_rescale_ts(packet, time_base_, stream->time_base);
+        if (av_write_frame(format_ctx, packet) < 0)
+        {
+            break;
+        }
+    }
+    packet->data = nullptr;
+    packet->size = 0;
+    av_packet_free(&packet);
+
+    if (started)
+    {
+        av_write_trailer(format_ctx);
+    }
+    avio_closep(&format_ctx->pb);
+    avformat_free_context(format_ctx);
+    if (!started)
+    {
+        unlink(path.c_str());
+    }
+    return started;
+}
+
+double ClipRing::Seconds() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.empty() ? 0.0 : static_cast<double>(entries_.back().captured - entries_.front().captured) / 1e6;
+}
+
+size_t ClipRing::Bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.empty() ? 0 : static_cast<size_t>(entries_.back().pos + entries_.back().size - entries_.front().pos);
+}
@@ -0,0 +1,85 @@
+#ifndef __CLIP_RING_HPP__
+#define __CLIP_RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/rational.h>
+}
+#endif
+
+struct AVCodecParameters;
+struct AVPacket;
+
+// The last few seconds of one rendition's encoded output, kept in memory so
+// a clip can be saved after something happened.
+//
+// Packets are copied into one preallocated arena used as a ring. Whole GOPs
+// are evicted from the old end, both when the arena is full and once the
+// remaining GOPs still cover max_seconds. The encode side appends without
+// waiting on exports: an export copies the packet index under a short lock,
+// reads packet data without it and discards any packet that was overwritten
+// in the meantime (seqlock style, by comparing with the eviction tail).
+class ClipRing
+{
+public:
+    // `bytes` of arena; `parameters` and `time_base` describe the encoder output
+    ClipRing(size_t bytes, int max_seconds, const AVCodecParameters *parameters, AVRational time_base);
+    ~ClipRing();
+    ClipRing(const ClipRing &) = delete;
+    ClipRing &operator=(const ClipRing &) = delete;
+
+    // Copies an encoded packet captured at `captured` (av_gettime) into the
+    // ring. One producer thread at a time, typically the encode strand.
+    void Append(const AVPacket *packet, int64_t captured);
+
+    // Writes the packets captured in [from, to] to an MP4 file, starting at
+    // the last key frame at or before `from`. Safe from any thread, returns
+    // false if there was nothing to write or the file could not be written.
+    bool Export(const std::string &path, int64_t from, int64_t to);
+
+    // seconds and bytes currently held
+    double Seconds() const;
+    size_t Bytes() const;
+
+private:
+    struct Entry
+    {
+        // position in the unwrapped byte stream, the arena offset is pos % capacity
+        uint64_t pos;
+        uint32_t size;
+        bool key;
+        int64_t pts;
+        int64_t dts;
+        int64_t captured;
+    };
+
+    void EvictGop();
+
+private:
+    uint8_t *arena_;
+    size_t capacity_;
+    int64_t max_us_;
+    AVCodecParameters *parameters_;
+    AVRational time_base_;
+
+    // producer only
+    uint64_t head_;
+    bool waiting_key_;
+
+    // everything before tail_ may be overwritten, readers check it after copying
+    std::atomic<uint64_t> tail_;
+    mutable std::mutex mutex_;
+    std::deque<Entry> entries_;
+    // number of entries of every GOP in entries_, oldest first
+    std::deque<size_t> gops_;
+};
+
+#endif  // __CLIP_RING_HPP__
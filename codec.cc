@@ -1,4 +1,5 @@
 #include "codec.hpp"
+#include "frame_timing.hpp"
 #include "scoped_exit.hpp"
 
 #ifdef __cplusplus
@@ -8,7 +9,9 @@ extern "C" {
 #include <libavdevice/avdevice.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
@@ -18,10 +21,16 @@ extern "C" {
 #include <iostream>
 #include <assert.h>
 #include <chrono>
+#include <ctime>
+#include <filesystem>
 #include <iterator>
+#include <algorithm>
 
-#define WIDTH 1920
-#define HEIGHT 1080
+
+// frames in flight between two stages; few, a shared memory source lends its slots
+#define STAGE_HANDOFF_SLOTS 4
+// AVFrames per hand over: the ring, one held by the producing stage and one in the consuming step
+#define STAGE_SHELLS (STAGE_HANDOFF_SLOTS + 2)
 
 #define STOP_LOOP_BREAK                                                \
     {                                                                  \
@@ -32,14 +41,6 @@ extern "C" {
         }                                                              \
     }
 
-#define DELAY_LOOP                                                      \
-    {                                                                   \
-        if (delay_.load())                                              \
-        {                                                               \
-            std::this_thread::sleep_for(std::chrono::milliseconds(30)); \
-        }                                                               \
-    }
-
 #define ERROR_BREAK(x)                                \
     {                                                 \
         if (x == AVERROR(EAGAIN) || x == AVERROR_EOF) \
@@ -56,37 +57,77 @@ RecordCodec::~RecordCodec()
     std::cout << "Transcoder destructed: " << name_ << std::endl;
 }
 
-RecordCodec::RecordCodec(std::string const &cameraName, std::string const &cameraUrl)
-    : name_(cameraName)
-    , url_(cameraUrl)
+RecordCodec::RecordCodec(StreamConfig const &config, ooknn::WorkerPool &pool)
+    : config_(config)
+    , name_(config.name)
+    , url_(config.input)
+    , raw_frame_(nullptr)
+    , filter_frame_(nullptr)
+    , scale_flags_(ScaleFlagsFromName(config.scale_filter))
+    , last_offered_(0)
+    , frames_filtered_(0)
+    , frames_skipped_(0)
+    , filter_fraph_(nullptr)
+    , buffer_src_ctx_(nullptr)
+    , buffer_sink_ctx_(nullptr)
     , stop_flag_(false)
     , running_flag_(false)
+    , capture_slot_(0)
+    , capture_anchored_(false)
+    , decoded_(STAGE_HANDOFF_SLOTS, ooknn::OverflowPolicy::Block)
+    , filtered_(STAGE_HANDOFF_SLOTS, ooknn::OverflowPolicy::Block)
+    , decoded_shells_(STAGE_SHELLS, ooknn::OverflowPolicy::DropNewest)
+    , filtered_shells_(STAGE_SHELLS, ooknn::OverflowPolicy::DropNewest)
+    , capture_clock_("capture")
+    , filter_clock_("filter")
+    , convert_clock_("convert")
+    , capture_strand_(StagePool("capture", pool))
+    , filter_strand_(StagePool("filter", pool))
+    , convert_strand_(StagePool("convert", pool))
 {
 
-    std::cout << "Constructing transcoder for " << cameraUrl;
+    std::cout << "Constructing transcoder for " << url_;
+
+    for (int i = 0; i < STAGE_SHELLS; ++i)
+    {
+        decoded_shells_.TryPush(av_frame_alloc());
+        filtered_shells_.TryPush(av_frame_alloc());
+    }
 
     // get the pixel format enum
-    this->raw_pix_fmt_ = av_get_pix_fmt("yuv420p");
-    this->encoder_pix_fmt_ = av_get_pix_fmt("yuv420p");
+    this->raw_pix_fmt_ = av_get_pix_fmt(config_.capture_pix_fmt.c_str());
+    this->encoder_pix_fmt_ = av_get_pix_fmt(config_.pix_fmt.c_str());
     assert(raw_pix_fmt_ != AV_PIX_FMT_NONE && encoder_pix_fmt_ != AV_PIX_FMT_NONE);
 
     std::cout << "Set pixel formats of the camera original/codec: "
-              << "yuv420p"
+              << config_.capture_pix_fmt
               << "/"
-              << "yuv420p" << std::endl;
+              << config_.pix_fmt << std::endl;
 
     //set framerate
-    frame_rate_ = (AVRational) {static_cast<int>(25), 1};
+    frame_rate_ = (AVRational) {CaptureFpsOf(config_), 1};
 
-    RegisterAll();
+    InitializeSource();
 
-    InitializeDecoder();
+    // the grid the device was opened with; a shared memory ring always lends
+    // its latest picture, whatever its producer's rate, so reads there follow the output rate
+    int capture_fps = config_.input_format == "shm" ? config_.fps : CaptureFpsOf(config_);
+    capture_period_ = std::chrono::microseconds(av_rescale_q(1, (AVRational) {1, capture_fps}, AV_TIME_BASE_Q));
 
-    InitializeEncoder();
+    // a filter graph only for a real filter chain, dropping to fps needs none
+    if (config_.filter.empty())
+    {
+        pacer_ = std::make_unique<FramePacer>((AVRational) {config_.fps, 1}, source_->TimeBase());
+        std::cout << name_ << ": " << av_q2d(frame_rate_) << " -> " << config_.fps << " fps without a filter graph" << std::endl;
+    }
+    else
+    {
+        InitFilters();
+    }
 
     InitializeConverter();
 
-    InitFilters();
+    InitializeRenditions(pool);
 }
 
 static void WriteFile(AVCodecContext *codecContext, AVFrame *frame, FILE *fp)
@@ -98,146 +139,325 @@ static void WriteFile(AVCodecContext *codecContext, AVFrame *frame, FILE *fp)
     fwrite(frame->data[2], 1, y_size / 4, fp);  //V
 }
 
-void RecordCodec::CheckDelay()
+ooknn::WorkerPool &RecordCodec::StagePool(const std::string &stage, ooknn::WorkerPool &shared)
 {
-    if (!delay_.load())
+    auto cpus = config_.stage_cpus.find(stage);
+    if (cpus == config_.stage_cpus.end())
     {
-        if (deque_.Size() > 100)
-        {
-            delay_.store(true);
-        }
+        return shared;
     }
-    if (delay_.load())
+    auto &pool = stage_pools_[stage];
+    if (!pool)
     {
-        if (deque_.Size() < 24)
-        {
-            delay_.store(false);
-        }
+        pool = std::make_unique<ooknn::WorkerPool>(0, cpus->second, name_ + " " + stage);
     }
+    return *pool;
 }
 
-void RecordCodec::EncodeFrameToSend()
+bool RecordCodec::HandOver(std::vector<AVFrame *> &held, ooknn::SpscRing<AVFrame *> &ring, ooknn::StageClock &clock)
 {
-    auto p = deque_.Pop();
-    if (!p)
+    size_t moved = 0;
+    while (moved < held.size() && ring.TryPush(held[moved]))
     {
-        return;
+        ++moved;
+    }
+    held.erase(held.begin(), held.begin() + static_cast<std::ptrdiff_t>(moved));
+    clock.SetBlocked(!held.empty());
+    return held.empty();
+}
+
+void RecordCodec::Drain(std::vector<AVFrame *> &held, ooknn::SpscRing<AVFrame *> &ring)
+{
+    for (auto &frame : held)
+    {
+        av_frame_free(&frame);
     }
+    held.clear();
+    while (auto frame = ring.TryPop())
+    {
+        av_frame_free(&*frame);
+    }
+}
 
-    auto p_clean = make_scoped_exit([&p]() { av_frame_free(&p); });
+AVFrame *RecordCodec::TakeShell(ooknn::SpscRing<AVFrame *> &shells)
+{
+    auto shell = shells.TryPop();
+    // a filter chain that duplicates frames can hold more than the shells cover
+    return shell ? *shell : av_frame_alloc();
+}
 
-    if (EncodeFrameToPacket(out_ctx_.codecContext, p, encoding_packet_) < 0)
+void RecordCodec::ReturnShell(ooknn::SpscRing<AVFrame *> &shells, AVFrame *&frame)
+{
+    av_frame_unref(frame);
+    if (!shells.TryPush(frame))
     {
-        return;
+        av_frame_free(&frame);
     }
-    auto pkt_clean = make_scoped_exit([&p = encoding_packet_]() { av_packet_unref(p); });
+    frame = nullptr;
+}
+
+bool RecordCodec::FlushRenditions()
+{
+    bool flushed = true;
+    for (auto &rendition : renditions_)
+    {
+        flushed = rendition->Flush() && flushed;
+    }
+    return flushed;
+}
+
+bool RecordCodec::FrameChanged(const AVFrame *frame, int64_t now)
+{
+    frames_filtered_.fetch_add(1, std::memory_order_relaxed);
+    if (!change_detector_)
+    {
+        return true;
+    }
+    // every frame is hashed, so the first changed tile is caught at the full rate
+    bool changed = change_detector_->Update(frame) > 0;
+    bool refresh = now - last_offered_ >= static_cast<int64_t>(config_.static_refresh_ms) * 1000;
+    for (auto &rendition : renditions_)
+    {
+        // a new client waits for an IDR, which needs a frame to encode
+        refresh = refresh || rendition->KeyFrameRequested();
+    }
+    if (!changed && !refresh)
+    {
+        frames_skipped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    last_offered_ = now;
+    return true;
+}
 
-    if (!encode_cb_)
+void RecordCodec::CaptureStep()
+{
+    if (stop_flag_.load())
+    {
+        return;
+    }
+    ooknn::StageStep step(capture_clock_);
+
+    auto now = ooknn::Clock::now();
+    // Live inputs pace themselves on a fixed grid from their first read (x11grab
+    // sleeps until its next frame time, stepping av_rescale_q(1, 1/fps, AV_TIME_BASE_Q)
+    // like capture_period_), so reads follow the same grid, computed from the
+    // anchor rather than summed so it cannot drift, and av_read_frame stays
+    // short. A late step skips the slots it missed rather than shifting every
+    // later read, which would leave each one waiting on the device.
+    capture_slot_ += 1 + std::max<int64_t>((now - capture_anchor_) / capture_period_ - capture_slot_, 0);
+    next_capture_ = capture_anchor_ + capture_slot_ * capture_period_;
+
+    // the previous picture goes first, meanwhile the device keeps only the latest one
+    size_t held = held_decoded_.size();
+    bool handed_over = HandOver(held_decoded_, decoded_, capture_clock_);
+    // the filter steps posted for these frames may have found the ring empty while they were held
+    if (held_decoded_.size() < held)
+    {
+        filter_strand_.Post([this]() { FilterStep(); }, now + capture_period_);
+    }
+    if (!handed_over)
     {
+        capture_strand_.PostAt(next_capture_, [this]() { CaptureStep(); }, capture_period_);
         return;
     }
 
-    static uint32_t skip = 4;
-    std::vector<uint8_t> data(encoding_packet_->data, encoding_packet_->data + encoding_packet_->size);
-    if (std::equal(prefix1.begin(), prefix1.end(), data.begin()))
+    int64_t captured = 0;
+    int statusCode = source_->Read(raw_frame_, captured);
+    if (statusCode < 0)
     {
-        skip = prefix1.size();
+        std::cout << name_ << ": end of input" << std::endl;
+        return;
     }
-    else if (std::equal(prefix2.begin(), prefix2.end(), data.begin()))
+    if (statusCode > 0 && !capture_anchored_)
     {
-        skip = prefix2.size();
+        // the first read waits for the device's first frame time when the
+        // pipeline came up within a period of opening it; from its return on,
+        // reads land just after the device's frame times instead of before them
+        capture_anchored_ = true;
+        capture_anchor_ = ooknn::Clock::now();
+        capture_slot_ = 1;
+        next_capture_ = capture_anchor_ + capture_period_;
     }
-    else
+    capture_strand_.PostAt(next_capture_, [this]() { CaptureStep(); }, capture_period_);
+    // nothing new from the source yet
+    if (statusCode == 0)
     {
-        std::for_each(data.begin(), data.begin() + 4, [](uint8_t ch) { printf("%x ", ch); });
-        printf("\n");
-        assert(false);
+        return;
     }
-    data.erase(data.begin(), data.begin() + skip);
-    encode_cb_(std::move(data));
+
+    FrameTiming capture_timing;
+    capture_timing.captured = captured;
+    capture_timing.decoded = av_gettime();
+    // the fps filter keeps opaque_ref on the frames it passes or duplicates
+    SetFrameTiming(raw_frame_, capture_timing);
+
+    AVFrame *decoded = TakeShell(decoded_shells_);
+    av_frame_move_ref(decoded, raw_frame_);
+    held_decoded_.push_back(decoded);
+    HandOver(held_decoded_, decoded_, capture_clock_);
+    filter_strand_.Post([this]() { FilterStep(); }, now + capture_period_);
 }
 
-void RecordCodec::EncodeFrame()
+void RecordCodec::FilterStep()
 {
-    while (true)
+    if (stop_flag_.load())
     {
-        if (stop_flag_.load())
-        {
-            break;
-        }
-        CheckDelay();
-        EncodeFrameToSend();
+        return;
+    }
+    ooknn::StageStep step(filter_clock_);
+
+    auto now = ooknn::Clock::now();
+    size_t held = held_filtered_.size();
+    bool handed_over = HandOver(held_filtered_, filtered_, filter_clock_);
+    // as in CaptureStep, the convert steps of held frames may be gone
+    if (held_filtered_.size() < held)
+    {
+        convert_strand_.Post([this]() { ConvertStep(); }, now + capture_period_);
+    }
+    if (!handed_over)
+    {
+        filter_strand_.PostAt(now + capture_period_, [this]() { FilterStep(); }, capture_period_);
+        return;
+    }
+    auto next = decoded_.TryPop();
+    if (!next)
+    {
+        return;
+    }
+    AVFrame *decoded = *next;
+    auto frame_clean = make_scoped_exit([this, &decoded]() { ReturnShell(decoded_shells_, decoded); });
+    FrameTiming capture_timing;
+    GetFrameTiming(decoded, capture_timing);
+    if (pacer_)
+    {
+        RunPacer(decoded, capture_timing);
+    }
+    else
+    {
+        RunFilterGraph(decoded, capture_timing);
     }
 
-    CleanDeque();
+    handed_over = HandOver(held_filtered_, filtered_, filter_clock_);
+    if (!filtered_.Empty())
+    {
+        convert_strand_.Post([this]() { ConvertStep(); }, now + capture_period_);
+    }
+    // a backlog left by a blocked step
+    if (handed_over && !decoded_.Empty())
+    {
+        filter_strand_.Post([this]() { FilterStep(); }, now + capture_period_);
+    }
+    else if (!handed_over)
+    {
+        filter_strand_.PostAt(now + capture_period_, [this]() { FilterStep(); }, capture_period_);
+    }
 }
 
-void RecordCodec::CleanDeque()
+void RecordCodec::RunPacer(AVFrame *decoded, const FrameTiming &capture_timing)
 {
-    while (!deque_.Empty())
+    int64_t slot = 0;
+    if (!pacer_->Accept(decoded->pts, slot))
     {
-        auto p = deque_.Pop();
-        if (p)
-        {
-            av_frame_free(&p);
-        }
+        return;
+    }
+    FrameTiming timing = capture_timing;
+    timing.filtered = av_gettime();
+    // an unchanged screen costs the tile hashes only, pts gaps make the encoder output variable rate
+    if (!FrameChanged(decoded, timing.filtered))
+    {
+        return;
     }
+    // the captured picture goes on as it is, only its pts moves to the output rate
+    AVFrame *filtered = TakeShell(filtered_shells_);
+    av_frame_move_ref(filtered, decoded);
+    filtered->pts = slot;
+    SetFrameTiming(filtered, timing);
+    held_filtered_.push_back(filtered);
 }
 
-void RecordCodec::Run()
+void RecordCodec::RunFilterGraph(AVFrame *decoded, const FrameTiming &capture_timing)
 {
-    delay_.store(false);
-    running_flag_.store(true);
+    int statusCode = av_buffersrc_add_frame_flags(buffer_src_ctx_, decoded, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (statusCode < 0)
+    {
+        return;
+    }
+    while (true)
+    {
+        STOP_LOOP_BREAK;
 
-    std::thread t([&]() { EncodeFrame(); });
-    auto thread_clean = make_scoped_exit([&t = t]() { t.join(); });
+        statusCode = av_buffersink_get_frame(buffer_sink_ctx_, filter_frame_);
 
-    while (!stop_flag_.load())
-    {
-        if (av_read_frame(in_ctx_.formatContext, decoding_packet_) < 0)
-        {
-            break;
-        }
-        auto pkt_clean = make_scoped_exit([&pkt = decoding_packet_]() { av_packet_unref(pkt); });
-        if (decoding_packet_->stream_index != in_ctx_.videoStream->index)
-        {
-            continue;
-        }
-        if (!DecodePacketToFrame(in_ctx_.codecContext, raw_frame_, decoding_packet_))
-        {
-            continue;
-        }
+        ERROR_BREAK(statusCode);
+
+        auto filter_clean = make_scoped_exit([&filter = filter_frame_]() { av_frame_unref(filter); });
 
-        auto frame_clean = make_scoped_exit([&frame = raw_frame_]() { av_frame_unref(frame); });
+        FrameTiming timing = capture_timing;
+        GetFrameTiming(filter_frame_, timing);
+        timing.filtered = av_gettime();
 
-        int statusCode = av_buffersrc_add_frame_flags(buffer_src_ctx_, raw_frame_, AV_BUFFERSRC_FLAG_KEEP_REF);
-        if (statusCode < 0)
+        if (!FrameChanged(filter_frame_, timing.filtered))
         {
             continue;
         }
-        while (true)
-        {
-            STOP_LOOP_BREAK;
-
-            DELAY_LOOP;
 
-            statusCode = av_buffersink_get_frame(buffer_sink_ctx_, filter_frame_);
+        AVFrame *filtered = TakeShell(filtered_shells_);
+        av_frame_move_ref(filtered, filter_frame_);
+        SetFrameTiming(filtered, timing);
+        held_filtered_.push_back(filtered);
+    }
+}
 
-            ERROR_BREAK(statusCode);
+void RecordCodec::ConvertStep()
+{
+    if (stop_flag_.load())
+    {
+        return;
+    }
+    ooknn::StageStep step(convert_clock_);
 
-            auto filter_clean = make_scoped_exit([&filter = filter_frame_]() { av_frame_unref(filter); });
+    auto now = ooknn::Clock::now();
+    // a rendition queue is still full, its encoder drains it
+    bool flushed = FlushRenditions();
+    convert_clock_.SetBlocked(!flushed);
+    if (!flushed)
+    {
+        convert_strand_.PostAt(now + capture_period_, [this]() { ConvertStep(); }, capture_period_);
+        return;
+    }
+    auto next = filtered_.TryPop();
+    if (!next)
+    {
+        return;
+    }
+    AVFrame *filtered = *next;
+    auto frame_clean = make_scoped_exit([this, &filtered]() { ReturnShell(filtered_shells_, filtered); });
+    FrameTiming timing;
+    GetFrameTiming(filtered, timing);
+
+    // color conversion happens once, the renditions share the converted picture
+    AVFrame *converted = converter_->Convert(filtered);
+    timing.converted = av_gettime();
+    SetFrameTiming(converted, timing);
+    for (auto &rendition : renditions_)
+    {
+        rendition->Offer(converted);
+    }
+    av_frame_free(&converted);
 
-            av_frame_make_writable(converted_frame_);
-            sws_scale(converter_ctx_, reinterpret_cast<const uint8_t *const *>(filter_frame_->data), filter_frame_->linesize, 0, static_cast<int>(frame_height_), converted_frame_->data, converted_frame_->linesize);
-            av_frame_copy_props(converted_frame_, filter_frame_);
-            AVFrame *cp = av_frame_clone(converted_frame_);
-            deque_.Push(std::move(cp));
-        }
+    if (!filtered_.Empty())
+    {
+        convert_strand_.Post([this]() { ConvertStep(); }, now + capture_period_);
     }
+}
 
-    AVFrame *p = NULL;
-    deque_.Push(std::move(p));
-    running_flag_.store(false);
+void RecordCodec::Start()
+{
+    running_flag_.store(true);
+    capture_anchor_ = ooknn::Clock::now();
+    capture_slot_ = -1;
+    capture_strand_.Post([this]() { CaptureStep(); }, capture_anchor_ + capture_period_);
 }
 
 void RecordCodec::Stop()
@@ -247,131 +467,106 @@ void RecordCodec::Stop()
         return;
 
     stop_flag_.store(true);
-
-    while (running_flag_.load())
+    // waits for the steps in progress, front to back, afterwards no frame reaches the renditions
+    capture_strand_.Close();
+    filter_strand_.Close();
+    convert_strand_.Close();
+    for (auto &rendition : renditions_)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        rendition->Stop();
     }
+    // no packets arrive anymore, the recorder finishes its queue and the open segment
+    if (recorder_)
+    {
+        recorder_->Stop();
+    }
+    running_flag_.store(false);
 
     CleanUp();
 }
 
-void RecordCodec::RegisterAll()
+void RecordCodec::InitializeSource()
 {
-
-    std::cout << "Registering ffmpeg stuff";
-
-    avdevice_register_all();
-}
-
-void RecordCodec::InitializeDecoder()
-{
-
-    std::cout << "Initialize decoder of the camera " << url_;
-
-    in_ctx_.formatContext = avformat_alloc_context();
-    std::cout << "Using Video4Linux2 API for decoding raw data";
-
-    AVInputFormat *inputFormat = av_find_input_format("x11grab");
-    AVDictionary *options = nullptr;
-
-    std::string s = std::to_string(WIDTH);
-    s += "*";
-    s += std::to_string(HEIGHT);
-    av_dict_set(&options, "video_size", s.data(), 0);
-    av_dict_set(&options, "pixel_format", av_get_pix_fmt_name(raw_pix_fmt_), 0);
-    av_dict_set(&options, "framerate", "25", 0);
-
-    int statCode = avformat_open_input(&in_ctx_.formatContext, url_.data(), inputFormat, &options);
-    av_dict_free(&options);
-    assert(statCode == 0);
-
-    statCode = avformat_find_stream_info(in_ctx_.formatContext, nullptr);
-    assert(statCode >= 0);
-    av_dump_format(in_ctx_.formatContext, 0, name_.data(), 0);
-
-    int videoStreamIndex = av_find_best_stream(in_ctx_.formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &in_ctx_.codec, 0);
-    assert(videoStreamIndex >= 0);
-    assert(in_ctx_.codec);
-    in_ctx_.videoStream = in_ctx_.formatContext->streams[videoStreamIndex];
-    in_ctx_.codecContext = avcodec_alloc_context3(in_ctx_.codec);
-    assert(in_ctx_.codecContext);
-    statCode = avcodec_parameters_to_context(in_ctx_.codecContext, in_ctx_.videoStream->codecpar);
-    assert(statCode >= 0);
-    in_ctx_.codecContext->thread_count = 8;
-    statCode = avcodec_open2(in_ctx_.codecContext, in_ctx_.codec, &options);
-    assert(statCode == 0);
-    frame_rate_ = in_ctx_.videoStream->r_frame_rate;
-    frame_width_ = static_cast<size_t>(in_ctx_.codecContext->width);
-    frame_height_ = static_cast<size_t>(in_ctx_.codecContext->height);
-    raw_pix_fmt_ = in_ctx_.codecContext->pix_fmt;
-    bit_rate_ = static_cast<size_t>(in_ctx_.codecContext->bit_rate);
-
-    std::cout << "Decoder params: width: " << frame_width_ << ", height: " << frame_height_ << ", pixel_fmt: "
-              << av_get_pix_fmt_name(raw_pix_fmt_) << ", framerate: " << frame_rate_.num << std::endl;
-
-    decoding_packet_ = av_packet_alloc();
-    av_init_packet(decoding_packet_);
+    source_ = CaptureSource::Create(config_);
+    frame_rate_ = source_->FrameRate();
+    frame_width_ = static_cast<size_t>(source_->Width());
+    frame_height_ = static_cast<size_t>(source_->Height());
+    raw_pix_fmt_ = source_->Format();
     raw_frame_ = av_frame_alloc();
 }
 
-void RecordCodec::InitializeEncoder()
+void RecordCodec::InitializeConverter()
 {
 
-    std::cout << "Initialize HEVC encoder" << std::endl;
-
-    int statCode = avformat_alloc_output_context2(&out_ctx_.formatContext, nullptr, "null", nullptr);
-    assert(statCode >= 0);
-
-    out_ctx_.codec = avcodec_find_encoder_by_name("libx264");
-    assert(out_ctx_.codec);
-
-    out_ctx_.videoStream = avformat_new_stream(out_ctx_.formatContext, out_ctx_.codec);
-    assert(out_ctx_.videoStream);
-    out_ctx_.videoStream->id = out_ctx_.formatContext->nb_streams - 1;
-
-    out_ctx_.codecContext = avcodec_alloc_context3(out_ctx_.codec);
-    assert(out_ctx_.codecContext);
-
-    out_ctx_.codecContext->width = static_cast<int>(WIDTH);
-    out_ctx_.codecContext->height = static_cast<int>(HEIGHT);
-
-    out_ctx_.codecContext->time_base = (AVRational) {1, static_cast<int>(25)};
-    out_ctx_.codecContext->framerate = (AVRational) {static_cast<int>(25), 1};
-
-    out_ctx_.codecContext->pix_fmt = encoder_pix_fmt_;
-    if (out_ctx_.formatContext->flags & AVFMT_GLOBALHEADER)
+    int threads = config_.convert_threads;
+    if (threads == 0)
     {
-        out_ctx_.codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        threads = std::clamp(static_cast<int>(frame_width_ * frame_height_ / (960 * 540)), 1, std::min(4, hardware));
+    }
+    // slice helpers share the CPUs of a pinned convert stage, more slices than
+    // those CPUs would only take turns on them
+    auto cpus = config_.stage_cpus.find("convert");
+    if (cpus != config_.stage_cpus.end())
+    {
+        threads = std::min(threads, static_cast<int>(cpus->second.size()));
     }
 
-    avcodec_parameters_from_context(out_ctx_.videoStream->codecpar, out_ctx_.codecContext);
-    AVDictionary *options = nullptr;
-    av_dict_set(&options, "preset", "ultrafast", 0);
-    statCode = avcodec_open2(out_ctx_.codecContext, out_ctx_.codec, NULL);
-    av_dict_free(&options);
-    assert(statCode == 0);
-    statCode = avformat_write_header(out_ctx_.formatContext, nullptr);
-    assert(statCode >= 0);
-
-    av_dump_format(out_ctx_.formatContext, out_ctx_.videoStream->index, "null", 1);
+    // capture size, encoder format: resizing is left to each rendition. The
+    // pool covers every queued frame of the slowest rendition plus the one in flight.
+    converter_ = std::make_unique<FrameConverter>(static_cast<int>(frame_width_), static_cast<int>(frame_height_), raw_pix_fmt_, static_cast<int>(frame_width_), static_cast<int>(frame_height_), encoder_pix_fmt_, config_.queue_capacity + 2, scale_flags_,
+                                                  threads, cpus == config_.stage_cpus.end() ? std::vector<int>() : cpus->second);
 
-    encoding_packet_ = av_packet_alloc();
-    av_init_packet(encoding_packet_);
+    if (config_.skip_static)
+    {
+        change_detector_ = std::make_unique<ChangeDetector>(static_cast<int>(frame_width_), static_cast<int>(frame_height_), raw_pix_fmt_);
+        std::cout << name_ << ": static frame detection on " << change_detector_->Tiles() << " tiles, " << change_detector_->Kernel() << std::endl;
+    }
 }
 
-void RecordCodec::InitializeConverter()
+void RecordCodec::InitializeRenditions(ooknn::WorkerPool &pool)
 {
+    for (const auto &rendition : RenditionsOf(config_))
+    {
+        renditions_.push_back(std::make_unique<Rendition>(config_, rendition, static_cast<int>(frame_width_), static_cast<int>(frame_height_), encoder_pix_fmt_, StagePool("encode", pool)));
+    }
 
-    converted_frame_ = av_frame_alloc();
-    converted_frame_->width = static_cast<int>(WIDTH);
-    converted_frame_->height = static_cast<int>(HEIGHT);
-    converted_frame_->format = encoder_pix_fmt_;
-    int statCode = av_frame_get_buffer(converted_frame_, 0);  // ref counted frame
-    assert(statCode == 0);
+    if (!config_.record && !config_.clip_seconds)
+    {
+        return;
+    }
+    // recording and clips tap the packets of one rendition, on its encode strand
+    Rendition *recorded = renditions_.front().get();
+    for (auto &rendition : renditions_)
+    {
+        if (rendition->Config().name == config_.record_rendition)
+        {
+            recorded = rendition.get();
+        }
+    }
+    AVCodecParameters *parameters = avcodec_parameters_alloc();
+    recorded->CodecParameters(parameters);
+    tap_name_ = recorded->Name();
+    std::replace(tap_name_.begin(), tap_name_.end(), '/', '-');
 
-    // create converter from raw pixel format to encoder supported pixel format
-    converter_ctx_ = sws_getCachedContext(nullptr, static_cast<int>(frame_width_), static_cast<int>(frame_height_), raw_pix_fmt_, converted_frame_->width, converted_frame_->height, encoder_pix_fmt_, SWS_LANCZOS, nullptr, nullptr, nullptr);
+    if (config_.record)
+    {
+        recorder_ = std::make_unique<SegmentRecorder>(config_, tap_name_, parameters, recorded->TimeBase(), [recorded]() { recorded->RequestKeyFrame(); });
+        recorded->AddOnPacketCallback([recorder = recorder_.get()](const AVPacket *packet, int64_t) { recorder->Write(packet); });
+    }
+    if (config_.clip_seconds)
+    {
+        // whole GOPs are evicted, so the window needs one GOP on top
+        int64_t bytes = config_.clip_buffer_mb << 20;
+        if (!bytes)
+        {
+            bytes = recorded->Config().bit_rate / 8 * (config_.clip_seconds + config_.gop / config_.fps + 1) * 5 / 4;
+        }
+        clip_ring_ = std::make_unique<ClipRing>(static_cast<size_t>(bytes), config_.clip_seconds, parameters, recorded->TimeBase());
+        recorded->AddOnPacketCallback([ring = clip_ring_.get()](const AVPacket *packet, int64_t captured) { ring->Append(packet, captured); });
+        std::cout << tap_name_ << ": keeping the last " << config_.clip_seconds << " s for clips in " << (bytes >> 20) << " MiB" << std::endl;
+    }
+    avcodec_parameters_free(&parameters);
 }
 
 void RecordCodec::InitFilters()
@@ -391,7 +586,7 @@ void RecordCodec::InitFilters()
     filter_fraph_ = avfilter_graph_alloc();
 
     char args[128];
-    snprintf(args, sizeof(args), "width=%d:height=%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d", (int)frame_width_, (int)frame_height_, raw_pix_fmt_, in_ctx_.videoStream->time_base.num, in_ctx_.videoStream->time_base.den, in_ctx_.videoStream->sample_aspect_ratio.num, in_ctx_.videoStream->sample_aspect_ratio.den, frame_rate_.num, frame_rate_.den);
+    snprintf(args, sizeof(args), "width=%d:height=%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d", (int)frame_width_, (int)frame_height_, raw_pix_fmt_, source_->TimeBase().num, source_->TimeBase().den, source_->SampleAspectRatio().num, source_->SampleAspectRatio().den, frame_rate_.num, frame_rate_.den);
     printf("%s\n", args);
 
     // create buffer source with the specified params
@@ -412,103 +607,129 @@ void RecordCodec::InitFilters()
     inputs->pad_idx = 0;
     inputs->next = nullptr;
 
-    // create filter query
-    char filter_setting[64] = {0};
-
-    //        const char *filter_descr = "movie=a.png[wm];[in][wm]overlay=5:5[out]";
-    snprintf(filter_setting, sizeof(filter_setting), "fps=fps=%d/%d", static_cast<int>(15), 1);
-    status = avfilter_graph_parse(filter_fraph_, filter_setting, inputs, outputs, nullptr);
+    // rate conversion first, the configured chain then sees output frames only
+    filter_query_ = "fps=fps=" + std::to_string(config_.fps) + "/1," + config_.filter;
+    status = avfilter_graph_parse(filter_fraph_, filter_query_.c_str(), inputs, outputs, nullptr);
+    if (status < 0)
+    {
+        std::cout << name_ << ": invalid filter chain '" << config_.filter << "'" << std::endl;
+    }
     assert(status >= 0);
 
     status = avfilter_graph_config(filter_fraph_, nullptr);
     assert(status >= 0);
+
+    // the chain may crop, scale or convert, the rest of the pipeline takes its output
+    frame_width_ = static_cast<size_t>(av_buffersink_get_w(buffer_sink_ctx_));
+    frame_height_ = static_cast<size_t>(av_buffersink_get_h(buffer_sink_ctx_));
+    raw_pix_fmt_ = static_cast<AVPixelFormat>(av_buffersink_get_format(buffer_sink_ctx_));
+    std::cout << name_ << ": filter graph " << filter_query_ << " -> " << frame_width_ << "x" << frame_height_ << " " << av_get_pix_fmt_name(raw_pix_fmt_) << std::endl;
 }
 
-int RecordCodec::DecodePacketToFrame(AVCodecContext *codecContext, AVFrame *frame, AVPacket *packet)
+void RecordCodec::CleanUp()
 {
 
-    int statCode = avcodec_send_packet(codecContext, packet);
-
-    if (statCode < 0)
+    Drain(held_decoded_, decoded_);
+    Drain(held_filtered_, filtered_);
+    for (auto *shells : {&decoded_shells_, &filtered_shells_})
     {
-        return statCode;
+        while (auto frame = shells->TryPop())
+        {
+            av_frame_free(&*frame);
+        }
     }
-
-    statCode = avcodec_receive_frame(codecContext, frame);
-
-    if (statCode == AVERROR(EAGAIN) || statCode == AVERROR_EOF)
+    if (pacer_)
     {
-        return statCode;
+        std::cout << name_ << ": " << pacer_->Dropped() << " captured frames dropped to " << config_.fps << " fps" << std::endl;
     }
+    avfilter_graph_free(&filter_fraph_);
+    av_frame_free(&raw_frame_);
+    av_frame_free(&filter_frame_);
+    // last, frames of a shared memory source reference its mapping until they are freed
+    source_.reset();
 
-    if (statCode < 0)
+    if (auto pool = converter_->Pool())
     {
-        return statCode;
+        std::cout << name_ << ": frame pool of " << pool->Size() << " buffers, hits: " << pool->Hits() << ", misses: " << pool->Misses() << std::endl;
     }
+    converter_.reset();
+    std::cout << name_ << ": " << FramesSkipped() << " of " << FramesFiltered() << " frames skipped as static" << std::endl;
 
-    return true;
+    std::cout << "Cleanup transcoder!" << std::endl;
 }
 
-int RecordCodec::EncodeFrameToPacket(AVCodecContext *codecContext, AVFrame *frame, AVPacket *packet)
+const std::vector<std::unique_ptr<Rendition>> &RecordCodec::Renditions() const
 {
+    return renditions_;
+}
 
-    int statCode = avcodec_send_frame(codecContext, frame);
-    if (statCode < 0)
-    {
-        return statCode;
-    }
-
-    statCode = avcodec_receive_packet(codecContext, packet);
-
-    if (statCode == AVERROR(EAGAIN) || statCode == AVERROR_EOF)
-    {
-        return statCode;
-    }
-
-    if (statCode < 0)
-    {
-        return statCode;
-    }
+const bool RecordCodec::Running() const
+{
+    return running_flag_.load();
+}
 
-    return statCode;
+std::string RecordCodec::Name() const
+{
+    return name_;
 }
 
-void RecordCodec::CleanUp()
+std::string RecordCodec::RtspUrl() const
 {
+    return url_;
+}
 
-    avfilter_graph_free(&filter_fraph_);
-    avio_close(out_ctx_.formatContext->pb);
-    sws_freeContext(converter_ctx_);
-    av_packet_free(&decoding_packet_);
-    av_packet_free(&encoding_packet_);
-    av_frame_free(&raw_frame_);
-    av_frame_free(&converted_frame_);
-    av_frame_free(&filter_frame_);
-    avcodec_free_context(&in_ctx_.codecContext);
-    avcodec_free_context(&out_ctx_.codecContext);
-    avformat_close_input(&in_ctx_.formatContext);
-    avformat_free_context(in_ctx_.formatContext);
-    avformat_free_context(out_ctx_.formatContext);
+const StreamConfig &RecordCodec::Config() const
+{
+    return config_;
+}
 
-    std::cout << "Cleanup transcoder!" << std::endl;
+uint64_t RecordCodec::FramesFiltered() const
+{
+    return frames_filtered_.load(std::memory_order_relaxed);
 }
 
-void RecordCodec::SetOnEncodedDataCallback(std::function<void(std::vector<uint8_t> &&)> callback)
+uint64_t RecordCodec::FramesSkipped() const
 {
-    encode_cb_ = std::move(callback);
+    return frames_skipped_.load(std::memory_order_relaxed);
 }
 
-const bool RecordCodec::Running() const
+SegmentRecorder *RecordCodec::Recorder() const
 {
-    return running_flag_.load();
+    return recorder_.get();
 }
 
-std::string RecordCodec::Name() const
+std::string RecordCodec::StageSummary()
 {
-    return name_;
+    std::string summary = capture_clock_.Summary() + ", " + filter_clock_.Summary() + ", " + convert_clock_.Summary();
+    for (auto &rendition : renditions_)
+    {
+        summary += ", " + rendition->EncodeClock().Summary();
+    }
+    return summary;
 }
 
-std::string RecordCodec::RtspUrl() const
+std::string RecordCodec::ExportClip()
 {
-    return url_;
+    if (!clip_ring_)
+    {
+        return "";
+    }
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm local {};
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::error_code error;
+    std::filesystem::create_directories(config_.clip_dir, error);
+    std::string path = config_.clip_dir + "/" + tap_name_ + "-clip-" + stamp + ".mp4";
+
+    int64_t to = av_gettime();
+    int64_t begin = to;
+    if (!clip_ring_->Export(path, to - static_cast<int64_t>(config_.clip_seconds) * 1000000, to))
+    {
+        std::cout << name_ << ": no clip written to " << path << std::endl;
+        return "";
+    }
+    std::cout << name_ << ": clip " << path << " written in " << (av_gettime() - begin) / 1000 << " ms" << std::endl;
+    return path;
 }
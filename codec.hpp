@@ -1,9 +1,23 @@
 #ifndef __CODEC_HPP__
 #define __CODEC_HPP__
 
-#include "thread_queue.hpp"
+#include "capture_source.hpp"
+#include "change_detector.hpp"
+#include "clip_ring.hpp"
+#include "converter.hpp"
+#include "config.hpp"
+#include "frame_pacer.hpp"
+#include "frame_timing.hpp"
+#include "rendition.hpp"
+#include "segment_recorder.hpp"
+#include "spsc_ring.hpp"
+#include "stage_clock.hpp"
+#include "worker_pool.hpp"
 #include <atomic>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -33,52 +47,81 @@ struct AVRational;
 using AVFramePtr = AVFrame *;
 using AVPacketPtr = AVPacket *;
 
-static const std::vector<uint8_t> prefix1 {0x00, 0x00, 0x00, 0x01};
-static const std::vector<uint8_t> prefix2 {0x00, 0x00, 0x01};
-
-struct TranscoderContext
-{
-    AVFormatContext *formatContext = nullptr;
-    AVCodecContext *codecContext = nullptr;
-    AVCodec *codec = nullptr;
-    AVStream *videoStream = nullptr;
-};
-
+// Capture -> rate conversion -> color conversion front end of a stream. Pictures
+// come from a CaptureSource, a demuxer and decoder or a shared memory ring.
+// Each converted frame is handed by reference to every Rendition.
+//
+// The stages run as steps on strands of their own and hand frames over
+// through small bounded rings, so capture, filtering, conversion and the
+// renditions' encoders overlap. A stage whose output ring is full holds its
+// frame and retries instead of waiting on a worker; capture then reads no
+// further and a live source drops at the device. Every stage, by default on
+// the shared pool, may be given threads pinned to CPUs of its own
+// (stage_cpus), and keeps busy/blocked/idle time (StageSummary).
 class RecordCodec
 {
 
-    using CallBackType = std::function<void(std::vector<uint8_t> &&)>;
-
 public:
-    explicit RecordCodec(std::string const &, std::string const &);
+    RecordCodec(StreamConfig const &, ooknn::WorkerPool &);
     ~RecordCodec();
     RecordCodec(const RecordCodec &) = delete;
     RecordCodec &operator=(const RecordCodec &) = delete;
 
-    void Run();
+    // schedules capture and encoding on the worker pool and returns
+    void Start();
     void Stop();
-    void SetOnEncodedDataCallback(std::function<void(std::vector<uint8_t> &&)> callback);
+    const std::vector<std::unique_ptr<Rendition>> &Renditions() const;
     const bool Running() const;
     std::string Name() const;
     std::string RtspUrl() const;
+    const StreamConfig &Config() const;
+    // frames out of rate conversion, and how many of them were skipped as unchanged
+    uint64_t FramesFiltered() const;
+    uint64_t FramesSkipped() const;
+    // null unless the stream is recorded
+    SegmentRecorder *Recorder() const;
+    // "capture busy ..., filter ..., convert ..., encode ..." since the previous call
+    std::string StageSummary();
+    // Saves the last clip_seconds held in memory as an MP4 under clip_dir and
+    // returns its path, empty if clips are off or nothing was captured yet.
+    // Runs on the calling thread, never on the capture or encode ones.
+    std::string ExportClip();
 
 private:
-    void RegisterAll();
-    void InitializeDecoder();
-    void InitializeEncoder();
+    void InitializeSource();
     void InitializeConverter();
+    void InitializeRenditions(ooknn::WorkerPool &);
     void InitFilters();
+    // the dedicated pool of `stage` when stage_cpus pins it, else `shared`
+    ooknn::WorkerPool &StagePool(const std::string &stage, ooknn::WorkerPool &shared);
 private:
-    void EncodeFrame();
-    int DecodePacketToFrame(AVCodecContext *, AVFrame *, AVPacket *);
-    int EncodeFrameToPacket(AVCodecContext *, AVFrame *, AVPacket *);
-    void CheckDelay();
-    void RunDelay();
-    void EncodeFrameToSend();
-    void CleanDeque();
+    // read and decode a captured picture
+    void CaptureStep();
+    // rate conversion, the filter chain if any, and static frame detection
+    void FilterStep();
+    // the frames out of the filter graph for `decoded`, held for the convert stage
+    void RunFilterGraph(AVFrame *decoded, const FrameTiming &capture_timing);
+    // the picture of `decoded` when it opens a new output slot of the pacer
+    void RunPacer(AVFrame *decoded, const FrameTiming &capture_timing);
+    // color conversion and the hand over to the renditions
+    void ConvertStep();
+    // Moves held frames into `ring` in order; false, with the stage counted as
+    // blocked, while some are still waiting for room.
+    static bool HandOver(std::vector<AVFrame *> &held, ooknn::SpscRing<AVFrame *> &ring, ooknn::StageClock &clock);
+    static void Drain(std::vector<AVFrame *> &held, ooknn::SpscRing<AVFrame *> &ring);
+    // An empty frame from the shells of a hand over, taken by its producing
+    // stage; allocated only while all of them are in flight.
+    static AVFrame *TakeShell(ooknn::SpscRing<AVFrame *> &shells);
+    // unrefs `frame` and gives its shell back from the consuming stage, freed if the shells are complete
+    static void ReturnShell(ooknn::SpscRing<AVFrame *> &shells, AVFrame *&frame);
+    // false while a rendition still has frames waiting for room in its queue
+    bool FlushRenditions();
+    // false if the filtered frame matches the previous one and no refresh is due
+    bool FrameChanged(const AVFrame *frame, int64_t now);
     void CleanUp();
 
 private:
+    StreamConfig config_;
     std::string name_;
 
     std::string url_;
@@ -87,26 +130,54 @@ private:
     AVPixelFormat raw_pix_fmt_;
     AVPixelFormat encoder_pix_fmt_;
     AVRational frame_rate_;
-    size_t bit_rate_;
-    TranscoderContext in_ctx_;
-    TranscoderContext out_ctx_;
+    std::unique_ptr<CaptureSource> source_;
     AVFrame *raw_frame_;
-    AVFrame *converted_frame_;
     AVFrame *filter_frame_;
-    AVPacket *decoding_packet_;
-    AVPacket *encoding_packet_;
-    SwsContext *converter_ctx_;
+    int scale_flags_;
+    std::unique_ptr<FrameConverter> converter_;
+    // null when skip_static is off
+    std::unique_ptr<ChangeDetector> change_detector_;
+    int64_t last_offered_;
+    std::atomic<uint64_t> frames_filtered_;
+    std::atomic<uint64_t> frames_skipped_;
+    // rate conversion when no filter chain is configured, null otherwise
+    std::unique_ptr<FramePacer> pacer_;
     std::string filter_query_;
     AVFilterGraph *filter_fraph_;
     AVFilterContext *buffer_src_ctx_;
     AVFilterContext *buffer_sink_ctx_;
     std::atomic_bool stop_flag_;
     std::atomic_bool running_flag_;
-    std::atomic_bool delay_;
-
-    //
-    ooknn::ThreadQueue<AVFrame *> deque_;
-    CallBackType encode_cb_;
+    // the device's frame step, capture reads run at capture_anchor_ + n * capture_period_
+    ooknn::Clock::duration capture_period_;
+    ooknn::Clock::time_point capture_anchor_;
+    int64_t capture_slot_;
+    // the anchor moves to the first picture read, when the device's own grid starts
+    bool capture_anchored_;
+    ooknn::Clock::time_point next_capture_;
+    // pools of pinned stages, declared before the strands and renditions running on them
+    std::map<std::string, std::unique_ptr<ooknn::WorkerPool>> stage_pools_;
+    // capture -> filter and filter -> convert hand overs, each with the
+    // frames the producing stage holds while its ring is full
+    ooknn::SpscRing<AVFrame *> decoded_;
+    ooknn::SpscRing<AVFrame *> filtered_;
+    std::vector<AVFrame *> held_decoded_;
+    std::vector<AVFrame *> held_filtered_;
+    // the AVFrames travelling through each hand over, recycled instead of allocated per frame
+    ooknn::SpscRing<AVFrame *> decoded_shells_;
+    ooknn::SpscRing<AVFrame *> filtered_shells_;
+    ooknn::StageClock capture_clock_;
+    ooknn::StageClock filter_clock_;
+    ooknn::StageClock convert_clock_;
+    // the steps of each stage are serialized, different stages run in parallel
+    ooknn::Strand capture_strand_;
+    ooknn::Strand filter_strand_;
+    ooknn::Strand convert_strand_;
+    std::vector<std::unique_ptr<Rendition>> renditions_;
+    // file name prefix of the rendition tapped by the recorder and the clip ring
+    std::string tap_name_;
+    std::unique_ptr<SegmentRecorder> recorder_;
+    std::unique_ptr<ClipRing> clip_ring_;
 };
 
 #endif  //
@@ -0,0 +1,469 @@
+#include "config.hpp"
+#include "encoder_profile.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#endif
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace
+{
+
+using StreamSetter = std::function<bool(StreamConfig &, const std::string &)>;
+using ServerSetter = std::function<bool(ServerConfig &, const std::string &)>;
+
+std::string Trim(const std::string &s)
+{
+    auto begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+    {
+        return "";
+    }
+    auto end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool ParseInt64(const std::string &value, int64_t min, int64_t &out)
+{
+    char *end = nullptr;
+    long long v = std::strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || v < min)
+    {
+        return false;
+    }
+    out = v;
+    return true;
+}
+
+template <typename T>
+StreamSetter Number(T StreamConfig::*field, int64_t min)
+{
+    return [field, min](StreamConfig &c, const std::string &value) {
+        int64_t v = 0;
+        if (!ParseInt64(value, min, v))
+        {
+            return false;
+        }
+        c.*field = static_cast<T>(v);
+        return true;
+    };
+}
+
+StreamSetter Text(std::string StreamConfig::*field)
+{
+    return [field](StreamConfig &c, const std::string &value) {
+        c.*field = value;
+        return !value.empty();
+    };
+}
+
+StreamSetter Flag(bool StreamConfig::*field)
+{
+    return [field](StreamConfig &c, const std::string &value) {
+        if (value == "yes" || value == "on" || value == "true" || value == "1")
+        {
+            c.*field = true;
+            return true;
+        }
+        if (value == "no" || value == "off" || value == "false" || value == "0")
+        {
+            c.*field = false;
+            return true;
+        }
+        return false;
+    };
+}
+
+StreamSetter OneOf(std::string StreamConfig::*field, std::set<std::string> allowed)
+{
+    return [field, allowed](StreamConfig &c, const std::string &value) {
+        if (!allowed.count(value))
+        {
+            return false;
+        }
+        c.*field = value;
+        return true;
+    };
+}
+
+// "0,2-3"
+bool ParseCpuList(const std::string &value, std::vector<int> &cpus)
+{
+    std::istringstream in(value);
+    std::string item;
+    cpus.clear();
+    while (std::getline(in, item, ','))
+    {
+        auto dash = item.find('-');
+        int64_t first = 0;
+        int64_t last = 0;
+        if (!ParseInt64(item.substr(0, dash), 0, first) ||
+            !ParseInt64(dash == std::string::npos ? item : item.substr(dash + 1), first, last) || last >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        for (int64_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus.empty();
+}
+
+// "<stage> <cpu list>"
+bool AddStageCpus(StreamConfig &c, const std::string &value)
+{
+    std::istringstream in(value);
+    std::string stage;
+    std::string list;
+    std::string rest;
+    static const std::set<std::string> stages = {"capture", "filter", "convert", "encode"};
+    if (!(in >> stage >> list) || (in >> rest) || !stages.count(stage))
+    {
+        return false;
+    }
+    return ParseCpuList(list, c.stage_cpus[stage]);
+}
+
+// "<name> <width>x<height> <bit_rate>"
+bool AddRendition(StreamConfig &c, const std::string &value)
+{
+    std::istringstream in(value);
+    RenditionConfig r;
+    std::string size;
+    std::string bit_rate;
+    std::string rest;
+    if (!(in >> r.name >> size >> bit_rate) || (in >> rest))
+    {
+        return false;
+    }
+    auto x = size.find('x');
+    int64_t w = 0;
+    int64_t h = 0;
+    if (x == std::string::npos || !ParseInt64(size.substr(0, x), 2, w) || !ParseInt64(size.substr(x + 1), 2, h) ||
+        !ParseInt64(bit_rate, 1000, r.bit_rate))
+    {
+        return false;
+    }
+    r.width = static_cast<int>(w);
+    r.height = static_cast<int>(h);
+    c.renditions.push_back(r);
+    return true;
+}
+
+const std::map<std::string, StreamSetter> &StreamKeys()
+{
+    static const std::map<std::string, StreamSetter> keys = {
+        {"name", Text(&StreamConfig::name)},
+        {"input_format", Text(&StreamConfig::input_format)},
+        {"input", Text(&StreamConfig::input)},
+        {"capture_width", Number(&StreamConfig::capture_width, 2)},
+        {"capture_height", Number(&StreamConfig::capture_height, 2)},
+        {"capture_fps", Number(&StreamConfig::capture_fps, 0)},
+        {"capture_pix_fmt", Text(&StreamConfig::capture_pix_fmt)},
+        {"width", Number(&StreamConfig::width, 2)},
+        {"height", Number(&StreamConfig::height, 2)},
+        {"fps", Number(&StreamConfig::fps, 1)},
+        {"bit_rate", Number(&StreamConfig::bit_rate, 1000)},
+        {"gop", Number(&StreamConfig::gop, 1)},
+        {"codec", OneOf(&StreamConfig::codec, {"h264", "hevc"})},
+        {"encoder", Text(&StreamConfig::encoder)},
+        {"encoder_profile", Text(&StreamConfig::encoder_profile)},
+        {"pix_fmt", Text(&StreamConfig::pix_fmt)},
+        {"encoder_threads", Number(&StreamConfig::encoder_threads, 0)},
+        {"rendition", AddRendition},
+        {"adaptive_bitrate", Flag(&StreamConfig::adaptive_bitrate)},
+        {"timestamp_sei", Flag(&StreamConfig::timestamp_sei)},
+        {"skip_static", Flag(&StreamConfig::skip_static)},
+        {"static_refresh_ms", Number(&StreamConfig::static_refresh_ms, 1)},
+        {"min_bit_rate", Number(&StreamConfig::min_bit_rate, 1000)},
+        {"abr_percentile", Number(&StreamConfig::abr_percentile, 1)},
+        {"convert_threads", Number(&StreamConfig::convert_threads, 0)},
+        {"filter", Text(&StreamConfig::filter)},
+        {"scale_filter", OneOf(&StreamConfig::scale_filter, {"fast_bilinear", "bilinear", "bicubic", "point", "area", "lanczos"})},
+        {"stage_cpus", AddStageCpus},
+        {"queue_capacity", Number(&StreamConfig::queue_capacity, 1)},
+        {"queue_overflow", OneOf(&StreamConfig::queue_overflow, {"drop-oldest", "drop-newest", "block"})},
+        {"latency_budget_ms", Number(&StreamConfig::latency_budget_ms, 1)},
+        {"gop_cache", Flag(&StreamConfig::gop_cache)},
+        {"gop_cache_speed", Number(&StreamConfig::gop_cache_speed, 0)},
+        {"transport", OneOf(&StreamConfig::transport, {"unicast", "multicast"})},
+        {"multicast_group", Text(&StreamConfig::multicast_group)},
+        {"multicast_port", Number(&StreamConfig::multicast_port, 1024)},
+        {"multicast_ttl", Number(&StreamConfig::multicast_ttl, 0)},
+        {"record", Flag(&StreamConfig::record)},
+        {"record_dir", Text(&StreamConfig::record_dir)},
+        {"record_format", OneOf(&StreamConfig::record_format, {"mp4", "ts"})},
+        {"record_rendition", Text(&StreamConfig::record_rendition)},
+        {"record_segment_seconds", Number(&StreamConfig::record_segment_seconds, 1)},
+        {"record_retention_minutes", Number(&StreamConfig::record_retention_minutes, 0)},
+        {"record_max_mb", Number(&StreamConfig::record_max_mb, 0)},
+        {"clip_seconds", Number(&StreamConfig::clip_seconds, 0)},
+        {"clip_buffer_mb", Number(&StreamConfig::clip_buffer_mb, 0)},
+        {"clip_dir", Text(&StreamConfig::clip_dir)},
+    };
+    return keys;
+}
+
+const std::map<std::string, ServerSetter> &ServerKeys()
+{
+    static const std::map<std::string, ServerSetter> keys = {
+        {"port", [](ServerConfig &c, const std::string &value) {
+             int64_t v = 0;
+             if (!ParseInt64(value, 1, v) || v > 65535)
+             {
+                 return false;
+             }
+             c.port = static_cast<unsigned int>(v);
+             return true;
+         }},
+        {"workers", [](ServerConfig &c, const std::string &value) {
+             int64_t v = 0;
+             if (!ParseInt64(value, 0, v))
+             {
+                 return false;
+             }
+             c.workers = static_cast<size_t>(v);
+             return true;
+         }},
+        {"worker_cpus", [](ServerConfig &c, const std::string &value) { return ParseCpuList(value, c.worker_cpus); }},
+        {"stats_interval", [](ServerConfig &c, const std::string &value) {
+             int64_t v = 0;
+             if (!ParseInt64(value, 0, v))
+             {
+                 return false;
+             }
+             c.stats_interval = static_cast<unsigned int>(v);
+             return true;
+         }},
+        {"rtp_send", [](ServerConfig &c, const std::string &value) {
+             if (value != "gso" && value != "sendmmsg" && value != "sendto")
+             {
+                 return false;
+             }
+             c.rtp_send = value;
+             return true;
+         }},
+    };
+    return keys;
+}
+
+bool Validate(const ServerConfig &config, const std::string &path)
+{
+    bool ok = true;
+    std::set<std::string> names;
+    for (const auto &s : config.streams)
+    {
+        if (!names.insert(s.name).second)
+        {
+            std::cerr << path << ": duplicate stream name '" << s.name << "'" << std::endl;
+            ok = false;
+        }
+        if (s.abr_percentile > 100)
+        {
+            std::cerr << path << ": stream '" << s.name << "': abr_percentile must be within 1..100" << std::endl;
+            ok = false;
+        }
+        const AVCodec *encoder = avcodec_find_encoder_by_name(EncoderOf(s).c_str());
+        if (!encoder || encoder->id != (s.codec == "hevc" ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264))
+        {
+            std::cerr << path << ": stream '" << s.name << "': encoder '" << EncoderOf(s) << "' "
+                      << (encoder ? "does not encode " + s.codec : std::string("is not available")) << std::endl;
+            ok = false;
+        }
+        if (!FindEncoderProfile(s.encoder_profile))
+        {
+            std::cerr << path << ": stream '" << s.name << "': unknown encoder profile '" << s.encoder_profile << "'" << std::endl;
+            ok = false;
+        }
+        std::set<std::string> renditions;
+        bool recorded = s.record_rendition.empty();
+        for (const auto &r : RenditionsOf(s))
+        {
+            recorded = recorded || r.name == s.record_rendition;
+            if (!renditions.insert(r.name).second)
+            {
+                std::cerr << path << ": stream '" << s.name << "': duplicate rendition '" << r.name << "'" << std::endl;
+                ok = false;
+            }
+            if (r.width % 2 || r.height % 2)
+            {
+                std::cerr << path << ": " << SessionName(s, r) << ": 4:2:0 output needs an even width and height" << std::endl;
+                ok = false;
+            }
+        }
+        if (!recorded)
+        {
+            std::cerr << path << ": stream '" << s.name << "': record_rendition '" << s.record_rendition << "' does not exist" << std::endl;
+            ok = false;
+        }
+        struct in_addr group {};
+        if (!s.multicast_group.empty() && (inet_pton(AF_INET, s.multicast_group.c_str(), &group) != 1 || (ntohl(group.s_addr) >> 28) != 0xe))
+        {
+            std::cerr << path << ": stream '" << s.name << "': multicast_group must be an IPv4 multicast address" << std::endl;
+            ok = false;
+        }
+        // RTP on the even port, RTCP on the odd one above, per rendition
+        if (s.multicast_port % 2 || s.multicast_port + 2 * static_cast<int>(renditions.size()) > 65536)
+        {
+            std::cerr << path << ": stream '" << s.name << "': multicast_port must be even and leave room for every rendition" << std::endl;
+            ok = false;
+        }
+        if (s.multicast_ttl > 255)
+        {
+            std::cerr << path << ": stream '" << s.name << "': multicast_ttl must be within 0..255" << std::endl;
+            ok = false;
+        }
+    }
+    if (config.streams.empty())
+    {
+        std::cerr << path << ": no [stream] section" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace
+
+std::vector<RenditionConfig> RenditionsOf(const StreamConfig &stream)
+{
+    if (!stream.renditions.empty())
+    {
+        return stream.renditions;
+    }
+    return {RenditionConfig {"", stream.width, stream.height, stream.bit_rate}};
+}
+
+int CaptureFpsOf(const StreamConfig &stream)
+{
+    return stream.capture_fps ? stream.capture_fps : stream.fps;
+}
+
+std::string EncoderOf(const StreamConfig &stream)
+{
+    if (!stream.encoder.empty())
+    {
+        return stream.encoder;
+    }
+    return stream.codec == "hevc" ? "libx265" : "libx264";
+}
+
+std::string SessionName(const StreamConfig &stream, const RenditionConfig &rendition)
+{
+    return rendition.name.empty() ? stream.name : stream.name + "/" + rendition.name;
+}
+
+bool LoadConfig(const std::string &path, ServerConfig &config)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot open config file " << path << std::endl;
+        return false;
+    }
+
+    config.streams.clear();
+    bool ok = true;
+    std::string line;
+    for (int line_no = 1; std::getline(in, line); ++line_no)
+    {
+        line = Trim(line.substr(0, line.find_first_of("#;")));
+        if (line.empty())
+        {
+            continue;
+        }
+        if (line == "[stream]")
+        {
+            config.streams.emplace_back();
+            continue;
+        }
+        auto eq = line.find('=');
+        if (eq == std::string::npos)
+        {
+            std::cerr << path << ":" << line_no << ": expected 'key = value' or [stream]" << std::endl;
+            ok = false;
+            continue;
+        }
+        std::string key = Trim(line.substr(0, eq));
+        std::string value = Trim(line.substr(eq + 1));
+
+        bool known = false;
+        bool valid = false;
+        if (config.streams.empty())
+        {
+            auto it = ServerKeys().find(key);
+            if ((known = it != ServerKeys().end()))
+            {
+                valid = it->second(config, value);
+            }
+        }
+        else
+        {
+            auto it = StreamKeys().find(key);
+            if ((known = it != StreamKeys().end()))
+            {
+                valid = it->second(config.streams.back(), value);
+            }
+        }
+        if (!known || !valid)
+        {
+            std::cerr << path << ":" << line_no << ": " << (known ? "invalid value for" : "unknown key") << " '" << key << "'" << std::endl;
+            ok = false;
+        }
+    }
+
+    return Validate(config, path) && ok;
+}
+
+bool ParseCommandLine(int argc, char **argv, ServerConfig &config)
+{
+    std::string config_path;
+    std::string port;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "c:p:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                config_path = optarg;
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-c config_file] [-p port]" << std::endl;
+                return false;
+        }
+    }
+
+    if (!config_path.empty())
+    {
+        if (!LoadConfig(config_path, config))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        config.streams.assign(1, StreamConfig());
+    }
+
+    if (!port.empty() && !ServerKeys().at("port")(config, port))
+    {
+        std::cerr << "invalid port " << port << std::endl;
+        return false;
+    }
+    return true;
+}
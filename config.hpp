@@ -0,0 +1,152 @@
+#ifndef __CONFIG_HPP__
+#define __CONFIG_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// One encoded output of a stream, published as rtsp://host:port/<stream>/<name>.
+struct RenditionConfig
+{
+    std::string name;
+    int width = 0;
+    int height = 0;
+    int64_t bit_rate = 0;
+};
+
+// Everything one capture -> encode -> RTSP stream needs. Defaults reproduce
+// the original single hardcoded x11grab stream.
+struct StreamConfig
+{
+    // RTSP path of the stream, rtsp://host:port/<name>
+    std::string name = "record";
+    // libavdevice / libavformat input, or "shm" for a frame ring written by
+    // another process (input is then its shm_open name, see shm_frame_ring.hpp)
+    std::string input_format = "x11grab";
+    std::string input = ":0.0";
+    int capture_width = 1920;
+    int capture_height = 1080;
+    // rate the input is read at, 0: fps. Only a source that cannot deliver
+    // fps itself needs more; the surplus is then dropped by timestamp.
+    int capture_fps = 0;
+    std::string capture_pix_fmt = "yuv420p";
+    // encoded output
+    int width = 1920;
+    int height = 1080;
+    int fps = 15;
+    int64_t bit_rate = 5000000;
+    int gop = 250;
+    // "h264" or "hevc"
+    std::string codec = "h264";
+    // libavcodec encoder for the codec, empty: libx264 or libx265
+    std::string encoder;
+    // preset, tune, threading, refresh and rate control, see encoder_profile.cc
+    std::string encoder_profile = "zerolatency-screen";
+    std::string pix_fmt = "yuv420p";
+    // threads of the encoder library itself, 0 lets it pick one per core
+    int encoder_threads = 1;
+    // "rendition = <name> <width>x<height> <bit_rate>", repeatable. Each one is
+    // scaled and encoded from the same capture; without any, width/height/bit_rate
+    // above describe the only output, published under the stream name alone.
+    std::vector<RenditionConfig> renditions;
+    // lower the encoder bitrate from RTCP receiver reports, never above the
+    // configured rate or below min_bit_rate; only libx264 with a bitrate
+    // profile, turned off with a note at startup otherwise
+    bool adaptive_bitrate = true;
+    int64_t min_bit_rate = 300000;
+    // 100 follows the worst client, 50 the median one
+    int abr_percentile = 100;
+    // prefix every access unit with a user_data_unregistered SEI carrying the
+    // capture time, see timestamp_sei.hpp
+    bool timestamp_sei = false;
+    // skip color conversion and encoding of captured frames whose tiles all
+    // match the previous frame, but still send one every static_refresh_ms
+    bool skip_static = true;
+    int static_refresh_ms = 1000;
+    // libavfilter chain applied after rate conversion, e.g. "crop=1280:720:0:0";
+    // empty leaves libavfilter out and converts the rate natively
+    std::string filter;
+    // swscale filter used when the output size differs from the capture size
+    std::string scale_filter = "bilinear";
+    // threads converting each captured frame in horizontal slices, the
+    // convert step's own included, at most the CPUs of a pinned convert
+    // stage; 0 picks about one per 960x540 of picture, up to 4
+    int convert_threads = 1;
+    // "stage_cpus = <stage> <cpu list>", repeatable: capture, filter, convert
+    // or encode then run on threads of their own, pinned to those CPUs (e.g.
+    // "convert 2,3" or "encode 4-7"), instead of on the shared workers
+    std::map<std::string, std::vector<int>> stage_cpus;
+    // capture -> encode frame queue
+    size_t queue_capacity = 8;
+    std::string queue_overflow = "drop-oldest";
+    // an RTSP client whose next frame is older than this skips ahead to the next IDR
+    int latency_budget_ms = 500;
+    // a joining client starts at the current GOP's IDR so it decodes at once;
+    // gop_cache_speed sends that GOP at a multiple of real time, 0 as fast as
+    // possible
+    bool gop_cache = true;
+    int gop_cache_speed = 0;
+    // "unicast": an RTP stream per RTSP client; "multicast": one source
+    // specific multicast stream per rendition that every client joins, sent to
+    // multicast_group (empty: a random 232.x.x.x address) at multicast_port,
+    // the next renditions at +2, +4, ... adaptive_bitrate only follows unicast
+    // clients.
+    std::string transport = "unicast";
+    std::string multicast_group;
+    int multicast_port = 18888;
+    int multicast_ttl = 1;
+    // write the encoded packets of one rendition to disk as well, in segments
+    // of record_segment_seconds named <record_dir>/<stream>[-<rendition>]-<date>-<time>.<format>
+    bool record = false;
+    std::string record_dir = "recordings";
+    // "mp4" (fragmented) or "ts"
+    std::string record_format = "mp4";
+    // rendition written to disk and kept for clips, empty: the first one
+    std::string record_rendition;
+    int record_segment_seconds = 60;
+    // oldest segments are deleted beyond these limits, 0 keeps them
+    int record_retention_minutes = 0;
+    int64_t record_max_mb = 0;
+    // keep the last clip_seconds of encoded video in memory (0: off); SIGUSR1
+    // saves them as <clip_dir>/<stream>[-<rendition>]-clip-<date>-<time>.mp4
+    int clip_seconds = 0;
+    // memory for it, 0 sizes it from the bitrate, clip_seconds and the GOP length
+    int64_t clip_buffer_mb = 0;
+    std::string clip_dir = "clips";
+};
+
+// Outputs of a stream, never empty.
+std::vector<RenditionConfig> RenditionsOf(const StreamConfig &stream);
+// capture rate of `stream`, capture_fps or else fps
+int CaptureFpsOf(const StreamConfig &stream);
+// encoder of `stream`, the configured one or the x264/x265 default of its codec
+std::string EncoderOf(const StreamConfig &stream);
+// RTSP path of a rendition of `stream`
+std::string SessionName(const StreamConfig &stream, const RenditionConfig &rendition);
+
+struct ServerConfig
+{
+    unsigned int port = 8554;
+    // capture and encode tasks of all streams share this many threads, 0: one per core
+    size_t workers = 0;
+    // pin the shared workers to these CPUs, e.g. "0-3"; empty leaves them to the scheduler
+    std::vector<int> worker_cpus;
+    // seconds between per stage latency reports in the log, 0 disables them
+    unsigned int stats_interval = 10;
+    // RTP egress: "gso" sends each access unit with one sendmmsg and UDP
+    // segmentation offload, "sendmmsg" without the offload, "sendto" one
+    // system call per packet; the kernel may lower gso to sendmmsg
+    std::string rtp_send = "gso";
+    std::vector<StreamConfig> streams;
+};
+
+// Reads an ini style file: global keys first, then one [stream] section per
+// stream. Problems are reported on stderr; returns false if any were found.
+bool LoadConfig(const std::string &path, ServerConfig &config);
+
+// record [-c config_file] [-p port]; without a config file one default stream is served.
+bool ParseCommandLine(int argc, char **argv, ServerConfig &config);
+
+#endif  // __CONFIG_HPP__
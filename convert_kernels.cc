@@ -0,0 +1,290 @@
+#include "convert_kernels.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_KERNELS_X86 1
+#endif
+
+// BT.601 limited range in 8 bit fixed point. Chroma is computed from the sum
+// of a 2x2 block, hence the two extra bits of shift.
+#define Y_R 66
+#define Y_G 129
+#define Y_B 25
+#define U_R (-38)
+#define U_G (-74)
+#define U_B 112
+#define V_R 112
+#define V_G (-94)
+#define V_B (-18)
+
+namespace
+{
+
+struct RowPair
+{
+    const uint8_t *src0;
+    const uint8_t *src1;
+    uint8_t *y0;
+    uint8_t *y1;
+    uint8_t *u;   // yuv420p only
+    uint8_t *v;   // yuv420p only
+    uint8_t *uv;  // nv12 only
+};
+
+inline uint8_t LumaOf(const uint8_t *p)
+{
+    return static_cast<uint8_t>(((Y_R * p[2] + Y_G * p[1] + Y_B * p[0] + 128) >> 8) + 16);
+}
+
+// scalar reference, also finishes the columns the SIMD loops leave over
+template <bool NV12>
+void ConvertRowPairC(const RowPair &rows, int x_begin, int width)
+{
+    for (int x = x_begin; x < width; x += 2)
+    {
+        const uint8_t *a = rows.src0 + 4 * x;
+        const uint8_t *b = rows.src1 + 4 * x;
+        rows.y0[x] = LumaOf(a);
+        rows.y0[x + 1] = LumaOf(a + 4);
+        rows.y1[x] = LumaOf(b);
+        rows.y1[x + 1] = LumaOf(b + 4);
+
+        int bs = a[0] + a[4] + b[0] + b[4];
+        int gs = a[1] + a[5] + b[1] + b[5];
+        int rs = a[2] + a[6] + b[2] + b[6];
+        auto u = static_cast<uint8_t>(((U_R * rs + U_G * gs + U_B * bs + 512) >> 10) + 128);
+        auto v = static_cast<uint8_t>(((V_R * rs + V_G * gs + V_B * bs + 512) >> 10) + 128);
+        if (NV12)
+        {
+            rows.uv[x] = u;
+            rows.uv[x + 1] = v;
+        }
+        else
+        {
+            rows.u[x / 2] = u;
+            rows.v[x / 2] = v;
+        }
+    }
+}
+
+template <bool NV12, void (*RowPairFn)(const RowPair &, int)>
+void ConvertRows(const uint8_t *src, int src_stride, uint8_t *const dst[], const int dst_stride[], int width, int y_begin, int y_end)
+{
+    for (int y = y_begin; y < y_end; y += 2)
+    {
+        RowPair rows;
+        rows.src0 = src + static_cast<ptrdiff_t>(y) * src_stride;
+        rows.src1 = rows.src0 + src_stride;
+        rows.y0 = dst[0] + static_cast<ptrdiff_t>(y) * dst_stride[0];
+        rows.y1 = rows.y0 + dst_stride[0];
+        if (NV12)
+        {
+            rows.u = rows.v = nullptr;
+            rows.uv = dst[1] + static_cast<ptrdiff_t>(y / 2) * dst_stride[1];
+        }
+        else
+        {
+            rows.u = dst[1] + static_cast<ptrdiff_t>(y / 2) * dst_stride[1];
+            rows.v = dst[2] + static_cast<ptrdiff_t>(y / 2) * dst_stride[2];
+            rows.uv = nullptr;
+        }
+        RowPairFn(rows, width);
+    }
+}
+
+template <bool NV12>
+void RowPairC(const RowPair &rows, int width)
+{
+    ConvertRowPairC<NV12>(rows, 0, width);
+}
+
+#ifdef CONVERT_KERNELS_X86
+
+__attribute__((target("sse4.1"))) inline __m128i LumaSSE41(__m128i px)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i b = _mm_and_si128(px, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+    __m128i y = _mm_add_epi32(_mm_mullo_epi32(r, _mm_set1_epi32(Y_R)), _mm_mullo_epi32(g, _mm_set1_epi32(Y_G)));
+    y = _mm_add_epi32(y, _mm_mullo_epi32(b, _mm_set1_epi32(Y_B)));
+    y = _mm_srli_epi32(_mm_add_epi32(y, _mm_set1_epi32(128)), 8);
+    return _mm_add_epi32(y, _mm_set1_epi32(16));
+}
+
+// per channel vertical sum of two rows of 4 pixels
+__attribute__((target("sse4.1"))) inline void ChannelSumsSSE41(__m128i top, __m128i bottom, __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    b = _mm_add_epi32(_mm_and_si128(top, mask), _mm_and_si128(bottom, mask));
+    g = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(top, 8), mask), _mm_and_si128(_mm_srli_epi32(bottom, 8), mask));
+    r = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(top, 16), mask), _mm_and_si128(_mm_srli_epi32(bottom, 16), mask));
+}
+
+__attribute__((target("sse4.1"))) inline __m128i ChromaSSE41(__m128i r, __m128i g, __m128i b, int cr, int cg, int cb)
+{
+    __m128i c = _mm_add_epi32(_mm_mullo_epi32(r, _mm_set1_epi32(cr)), _mm_mullo_epi32(g, _mm_set1_epi32(cg)));
+    c = _mm_add_epi32(c, _mm_mullo_epi32(b, _mm_set1_epi32(cb)));
+    c = _mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10);
+    return _mm_add_epi32(c, _mm_set1_epi32(128));
+}
+
+// 8 pixels of two rows per iteration
+template <bool NV12>
+__attribute__((target("sse4.1"))) void RowPairSSE41(const RowPair &rows, int width)
+{
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.src0 + 4 * x));
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.src0 + 4 * x + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.src1 + 4 * x));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.src1 + 4 * x + 16));
+
+        __m128i ytop = _mm_packus_epi32(LumaSSE41(t0), LumaSSE41(t1));
+        __m128i ybottom = _mm_packus_epi32(LumaSSE41(b0), LumaSSE41(b1));
+        __m128i y8 = _mm_packus_epi16(ytop, ybottom);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(rows.y0 + x), y8);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(rows.y1 + x), _mm_srli_si128(y8, 8));
+
+        __m128i bl, gl, rl, bh, gh, rh;
+        ChannelSumsSSE41(t0, b0, bl, gl, rl);
+        ChannelSumsSSE41(t1, b1, bh, gh, rh);
+        __m128i bs = _mm_hadd_epi32(bl, bh);
+        __m128i gs = _mm_hadd_epi32(gl, gh);
+        __m128i rs = _mm_hadd_epi32(rl, rh);
+        __m128i u = ChromaSSE41(rs, gs, bs, U_R, U_G, U_B);
+        __m128i v = ChromaSSE41(rs, gs, bs, V_R, V_G, V_B);
+        // u0..u3 in the low dword, v0..v3 in the next one
+        __m128i uv8 = _mm_packus_epi16(_mm_packus_epi32(u, v), _mm_setzero_si128());
+        if (NV12)
+        {
+            __m128i interleaved = _mm_unpacklo_epi8(uv8, _mm_srli_si128(uv8, 4));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(rows.uv + x), interleaved);
+        }
+        else
+        {
+            int32_t u4 = _mm_cvtsi128_si32(uv8);
+            int32_t v4 = _mm_extract_epi32(uv8, 1);
+            memcpy(rows.u + x / 2, &u4, 4);
+            memcpy(rows.v + x / 2, &v4, 4);
+        }
+    }
+    ConvertRowPairC<NV12>(rows, x, width);
+}
+
+__attribute__((target("avx2"))) inline __m256i LumaAVX2(__m256i px)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i b = _mm256_and_si256(px, mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+    __m256i y = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(Y_R)), _mm256_mullo_epi32(g, _mm256_set1_epi32(Y_G)));
+    y = _mm256_add_epi32(y, _mm256_mullo_epi32(b, _mm256_set1_epi32(Y_B)));
+    y = _mm256_srli_epi32(_mm256_add_epi32(y, _mm256_set1_epi32(128)), 8);
+    return _mm256_add_epi32(y, _mm256_set1_epi32(16));
+}
+
+// 16 luma values of two 8 pixel vectors, in pixel order
+__attribute__((target("avx2"))) inline __m128i PackLumaAVX2(__m256i a, __m256i b)
+{
+    // packus interleaves 128 bit lanes, the permute restores pixel order
+    __m256i y16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+    return _mm_packus_epi16(_mm256_castsi256_si128(y16), _mm256_extracti128_si256(y16, 1));
+}
+
+__attribute__((target("avx2"))) inline void ChannelSumsAVX2(__m256i top, __m256i bottom, __m256i &b, __m256i &g, __m256i &r)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    b = _mm256_add_epi32(_mm256_and_si256(top, mask), _mm256_and_si256(bottom, mask));
+    g = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(top, 8), mask), _mm256_and_si256(_mm256_srli_epi32(bottom, 8), mask));
+    r = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(top, 16), mask), _mm256_and_si256(_mm256_srli_epi32(bottom, 16), mask));
+}
+
+__attribute__((target("avx2"))) inline __m256i ChromaAVX2(__m256i r, __m256i g, __m256i b, int cr, int cg, int cb)
+{
+    __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(cr)), _mm256_mullo_epi32(g, _mm256_set1_epi32(cg)));
+    c = _mm256_add_epi32(c, _mm256_mullo_epi32(b, _mm256_set1_epi32(cb)));
+    c = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(512)), 10);
+    return _mm256_add_epi32(c, _mm256_set1_epi32(128));
+}
+
+// 8 chroma values in sample order as bytes in the low half
+__attribute__((target("avx2"))) inline __m128i PackChromaAVX2(__m256i c)
+{
+    __m128i c16 = _mm_packus_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+    return _mm_packus_epi16(c16, c16);
+}
+
+// 16 pixels of two rows per iteration
+template <bool NV12>
+__attribute__((target("avx2"))) void RowPairAVX2(const RowPair &rows, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i t0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.src0 + 4 * x));
+        __m256i t1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.src0 + 4 * x + 32));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.src1 + 4 * x));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.src1 + 4 * x + 32));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rows.y0 + x), PackLumaAVX2(LumaAVX2(t0), LumaAVX2(t1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rows.y1 + x), PackLumaAVX2(LumaAVX2(b0), LumaAVX2(b1)));
+
+        __m256i bl, gl, rl, bh, gh, rh;
+        ChannelSumsAVX2(t0, b0, bl, gl, rl);
+        ChannelSumsAVX2(t1, b1, bh, gh, rh);
+        // horizontal pair sums, again lane interleaved until the permute
+        __m256i bs = _mm256_permute4x64_epi64(_mm256_hadd_epi32(bl, bh), 0xD8);
+        __m256i gs = _mm256_permute4x64_epi64(_mm256_hadd_epi32(gl, gh), 0xD8);
+        __m256i rs = _mm256_permute4x64_epi64(_mm256_hadd_epi32(rl, rh), 0xD8);
+        __m128i u8 = PackChromaAVX2(ChromaAVX2(rs, gs, bs, U_R, U_G, U_B));
+        __m128i v8 = PackChromaAVX2(ChromaAVX2(rs, gs, bs, V_R, V_G, V_B));
+        if (NV12)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(rows.uv + x), _mm_unpacklo_epi8(u8, v8));
+        }
+        else
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(rows.u + x / 2), u8);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(rows.v + x / 2), v8);
+        }
+    }
+    ConvertRowPairC<NV12>(rows, x, width);
+}
+
+#endif  // CONVERT_KERNELS_X86
+
+}  // namespace
+
+RgbToYuvKernel FindRgbToYuvKernel(AVPixelFormat src, AVPixelFormat dst, const char **name)
+{
+    // alpha is ignored, so bgra converts exactly like bgr0
+    if (src != AV_PIX_FMT_BGR0 && src != AV_PIX_FMT_BGRA)
+    {
+        return nullptr;
+    }
+    if (dst != AV_PIX_FMT_YUV420P && dst != AV_PIX_FMT_NV12)
+    {
+        return nullptr;
+    }
+    bool nv12 = dst == AV_PIX_FMT_NV12;
+
+#ifdef CONVERT_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = nv12 ? "avx2 bgr0->nv12" : "avx2 bgr0->yuv420p";
+        return nv12 ? &ConvertRows<true, RowPairAVX2<true>> : &ConvertRows<false, RowPairAVX2<false>>;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        *name = nv12 ? "sse4.1 bgr0->nv12" : "sse4.1 bgr0->yuv420p";
+        return nv12 ? &ConvertRows<true, RowPairSSE41<true>> : &ConvertRows<false, RowPairSSE41<false>>;
+    }
+#endif
+    *name = nv12 ? "c bgr0->nv12" : "c bgr0->yuv420p";
+    return nv12 ? &ConvertRows<true, RowPairC<true>> : &ConvertRows<false, RowPairC<false>>;
+}
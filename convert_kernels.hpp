@@ -0,0 +1,27 @@
+#ifndef __CONVERT_KERNELS_HPP__
+#define __CONVERT_KERNELS_HPP__
+
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+// Converts rows [y_begin, y_end) of a packed 32-bit B,G,R,x picture into
+// planar (yuv420p: dst[0..2]) or semi-planar (nv12: dst[0..1]) 4:2:0 using
+// BT.601 limited range. width, y_begin and y_end must be even.
+using RgbToYuvKernel = void (*)(const uint8_t *src,
+                                int src_stride,
+                                uint8_t *const dst[],
+                                const int dst_stride[],
+                                int width,
+                                int y_begin,
+                                int y_end);
+
+// Best kernel for this CPU, or nullptr when the pair has no hand-written path.
+// `name` receives a short description of the selected implementation.
+RgbToYuvKernel FindRgbToYuvKernel(AVPixelFormat src, AVPixelFormat dst, const char **name);
+
+#endif  // __CONVERT_KERNELS_HPP__
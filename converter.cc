@@ -0,0 +1,231 @@
+#include "converter.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+
+// rows a sliced swscale conversion reads beyond each slice edge, enough for
+// the vertical chroma filters up to lanczos
+#define SLICE_MARGIN 16
+// slices shorter than this cost more in hand over than they save
+#define SLICE_MIN_ROWS 64
+
+// log2 of the vertical subsampling of `plane` in `format`
+static int PlaneShift(AVPixelFormat format, int plane)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+    return chroma ? desc->log2_chroma_h : 0;
+}
+
+// `frame` planes moved down to row `y`, which is a multiple of the subsampling
+static void OffsetPlanes(AVPixelFormat format, uint8_t *const data[], const int linesize[], int y, uint8_t *out[4])
+{
+    int planes = av_pix_fmt_count_planes(format);
+    for (int i = 0; i < 4; ++i)
+    {
+        out[i] = i < planes ? data[i] + static_cast<ptrdiff_t>(y >> PlaneShift(format, i)) * linesize[i] : nullptr;
+    }
+}
+
+static const char *ScaleFilterName(int flags)
+{
+    if (flags & SWS_FAST_BILINEAR)
+        return "fast_bilinear";
+    if (flags & SWS_BILINEAR)
+        return "bilinear";
+    if (flags & SWS_BICUBIC)
+        return "bicubic";
+    if (flags & SWS_POINT)
+        return "point";
+    if (flags & SWS_AREA)
+        return "area";
+    if (flags & SWS_LANCZOS)
+        return "lanczos";
+    return "other";
+}
+
+int ScaleFlagsFromName(const std::string &name)
+{
+    if (name == "fast_bilinear")
+        return SWS_FAST_BILINEAR;
+    if (name == "bicubic")
+        return SWS_BICUBIC;
+    if (name == "point")
+        return SWS_POINT;
+    if (name == "area")
+        return SWS_AREA;
+    if (name == "lanczos")
+        return SWS_LANCZOS;
+    return SWS_BILINEAR;
+}
+
+FrameConverter::FrameConverter(int src_width,
+                               int src_height,
+                               AVPixelFormat src_format,
+                               int dst_width,
+                               int dst_height,
+                               AVPixelFormat dst_format,
+                               size_t pool_size,
+                               int scale_flags,
+                               int threads,
+                               std::vector<int> cpus)
+    : src_width_(src_width)
+    , src_height_(src_height)
+    , src_format_(src_format)
+    , dst_width_(dst_width)
+    , dst_height_(dst_height)
+    , dst_format_(dst_format)
+    , mode_(Mode::Scale)
+    , kernel_(nullptr)
+    , sws_ctx_(nullptr)
+{
+    bool same_size = src_width == dst_width && src_height == dst_height;
+    const char *kernel_name = nullptr;
+
+    if (same_size && src_format == dst_format)
+    {
+        mode_ = Mode::Passthrough;
+        description_ = "passthrough";
+    }
+    else
+    {
+        if (same_size && src_width % 2 == 0 && src_height % 2 == 0)
+        {
+            kernel_ = FindRgbToYuvKernel(src_format, dst_format, &kernel_name);
+        }
+        if (kernel_)
+        {
+            mode_ = Mode::Kernel;
+            description_ = kernel_name;
+        }
+        else
+        {
+            mode_ = Mode::Scale;
+            sws_ctx_ = sws_getCachedContext(nullptr, src_width, src_height, src_format, dst_width, dst_height, dst_format, scale_flags, nullptr, nullptr, nullptr);
+            assert(sws_ctx_);
+            description_ = std::string("swscale ") + ScaleFilterName(scale_flags);
+        }
+    }
+
+    if (mode_ != Mode::Passthrough)
+    {
+        pool_ = std::make_unique<FramePool>(dst_width, dst_height, dst_format, pool_size);
+        InitializeSlices(threads, scale_flags, std::move(cpus));
+    }
+
+    std::cout << "Converter " << av_get_pix_fmt_name(src_format) << " " << src_width << "x" << src_height << " -> "
+              << av_get_pix_fmt_name(dst_format) << " " << dst_width << "x" << dst_height << ": " << description_ << std::endl;
+}
+
+FrameConverter::~FrameConverter()
+{
+    for (auto &slice : slices_)
+    {
+        sws_freeContext(slice.sws_ctx);
+        av_freep(&slice.scratch[0]);
+    }
+    sws_freeContext(sws_ctx_);
+}
+
+void FrameConverter::InitializeSlices(int threads, int scale_flags, std::vector<int> cpus)
+{
+    const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get(src_format_);
+    const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(dst_format_);
+    // slicing rows needs rows that map 1:1 and no palette
+    if (src_height_ != dst_height_ || (src_desc->flags & AV_PIX_FMT_FLAG_PAL) || (dst_desc->flags & AV_PIX_FMT_FLAG_PAL))
+    {
+        return;
+    }
+    // boundaries on a common multiple of both subsamplings, and of the kernels' 2 rows
+    int align = std::max({2, 1 << src_desc->log2_chroma_h, 1 << dst_desc->log2_chroma_h});
+    int count = std::min(threads, dst_height_ / SLICE_MIN_ROWS);
+    if (count < 2)
+    {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        Slice slice {};
+        slice.y_begin = dst_height_ * i / count / align * align;
+        slice.y_end = i + 1 == count ? dst_height_ : dst_height_ * (i + 1) / count / align * align;
+        slice.src_begin = slice.y_begin;
+        slice.src_end = slice.y_end;
+        if (mode_ == Mode::Scale)
+        {
+            slice.src_begin = std::max(0, slice.y_begin - SLICE_MARGIN);
+            slice.src_end = std::min(dst_height_, slice.y_end + SLICE_MARGIN);
+            int rows = slice.src_end - slice.src_begin;
+            slice.sws_ctx = sws_getContext(src_width_, rows, src_format_, dst_width_, rows, dst_format_, scale_flags, nullptr, nullptr, nullptr);
+            assert(slice.sws_ctx);
+            int statCode = av_image_alloc(slice.scratch, slice.scratch_linesize, dst_width_, rows, dst_format_, 64);
+            assert(statCode >= 0);
+        }
+        slices_.push_back(slice);
+    }
+    slice_group_ = std::make_unique<ooknn::SliceGroup>(static_cast<size_t>(count), std::move(cpus));
+    description_ += ", " + std::to_string(count) + " slices";
+}
+
+void FrameConverter::ConvertSlice(const AVFrame *src, AVFrame *out, const Slice &slice) const
+{
+    if (mode_ == Mode::Kernel)
+    {
+        kernel_(src->data[0], src->linesize[0], out->data, out->linesize, dst_width_, slice.y_begin, slice.y_end);
+        return;
+    }
+
+    uint8_t *src_planes[4];
+    OffsetPlanes(src_format_, src->data, src->linesize, slice.src_begin, src_planes);
+    sws_scale(slice.sws_ctx, src_planes, src->linesize, 0, slice.src_end - slice.src_begin, slice.scratch, slice.scratch_linesize);
+
+    // the margins were only there for the chroma filter, the neighbours own those rows
+    uint8_t *dst_planes[4];
+    OffsetPlanes(dst_format_, out->data, out->linesize, slice.y_begin, dst_planes);
+    for (int i = 0; i < av_pix_fmt_count_planes(dst_format_); ++i)
+    {
+        int shift = PlaneShift(dst_format_, i);
+        const uint8_t *from = slice.scratch[i] + static_cast<ptrdiff_t>((slice.y_begin - slice.src_begin) >> shift) * slice.scratch_linesize[i];
+        int rows = ((slice.y_end + (1 << shift) - 1) >> shift) - (slice.y_begin >> shift);
+        av_image_copy_plane(dst_planes[i], out->linesize[i], from, slice.scratch_linesize[i], av_image_get_linesize(dst_format_, dst_width_, i), rows);
+    }
+}
+
+AVFrame *FrameConverter::Convert(const AVFrame *src)
+{
+    assert(src->width == src_width_ && src->height == src_height_ && src->format == src_format_);
+
+    if (mode_ == Mode::Passthrough)
+    {
+        // a new reference to the same buffers, the encoder reads them directly
+        AVFrame *out = av_frame_clone(src);
+        assert(out);
+        return out;
+    }
+
+    AVFrame *out = pool_->Acquire();
+    if (!slices_.empty())
+    {
+        slice_group_->Run(slices_.size(), [this, src, out](size_t i) { ConvertSlice(src, out, slices_[i]); });
+    }
+    else if (mode_ == Mode::Kernel)
+    {
+        kernel_(src->data[0], src->linesize[0], out->data, out->linesize, dst_width_, 0, dst_height_);
+    }
+    else
+    {
+        sws_scale(sws_ctx_, reinterpret_cast<const uint8_t *const *>(src->data), src->linesize, 0, src_height_, out->data, out->linesize);
+    }
+    av_frame_copy_props(out, src);
+    return out;
+}
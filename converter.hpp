@@ -0,0 +1,103 @@
+#ifndef __CONVERTER_HPP__
+#define __CONVERTER_HPP__
+
+#include "convert_kernels.hpp"
+#include "frame_pool.hpp"
+#include "slice_group.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+struct AVFrame;
+struct SwsContext;
+
+// SWS_* flag for a filter name as used in the stream config ("bilinear", "lanczos", ...)
+int ScaleFlagsFromName(const std::string &name);
+
+// Pixel conversion stage between the filter graph and the encoder queue.
+// Picks the cheapest path once at construction:
+//   passthrough - same format and size, the source frame is referenced, not copied
+//   kernel      - same size, hand-written SIMD colorspace conversion into a pooled frame
+//   scale       - swscale with the configured filter, only for real resizes or other formats
+//
+// With `threads` > 1 a frame is converted in horizontal slices in parallel.
+// Slice boundaries fall on rows that are a multiple of every chroma
+// subsampling involved. The kernels average whole 2x2 blocks, so their
+// slices are exact. swscale filters chroma across rows, so every slice has
+// its own context that also reads SLICE_MARGIN rows beyond each edge, and
+// only the slice's own rows are kept. Resizes that change the height stay
+// in one piece.
+class FrameConverter
+{
+public:
+    enum class Mode
+    {
+        Passthrough,
+        Kernel,
+        Scale,
+    };
+
+    FrameConverter(int src_width,
+                   int src_height,
+                   AVPixelFormat src_format,
+                   int dst_width,
+                   int dst_height,
+                   AVPixelFormat dst_format,
+                   size_t pool_size,
+                   int scale_flags,
+                   int threads = 1,
+                   std::vector<int> cpus = {});
+    ~FrameConverter();
+    FrameConverter(const FrameConverter &) = delete;
+    FrameConverter &operator=(const FrameConverter &) = delete;
+
+    // new frame with `src` in the destination format, caller owns it
+    AVFrame *Convert(const AVFrame *src);
+
+    Mode GetMode() const { return mode_; }
+    const std::string &Description() const { return description_; }
+    // nullptr in passthrough mode, which never allocates
+    const FramePool *Pool() const { return pool_.get(); }
+
+private:
+    struct Slice
+    {
+        // destination rows of the slice
+        int y_begin;
+        int y_end;
+        // source rows converted, the slice plus its margins
+        int src_begin;
+        int src_end;
+        SwsContext *sws_ctx;
+        // the conversion of [src_begin, src_end), of which the slice is copied out
+        uint8_t *scratch[4];
+        int scratch_linesize[4];
+    };
+
+    void InitializeSlices(int threads, int scale_flags, std::vector<int> cpus);
+    void ConvertSlice(const AVFrame *src, AVFrame *out, const Slice &slice) const;
+
+private:
+    int src_width_;
+    int src_height_;
+    AVPixelFormat src_format_;
+    int dst_width_;
+    int dst_height_;
+    AVPixelFormat dst_format_;
+    Mode mode_;
+    std::string description_;
+    RgbToYuvKernel kernel_;
+    SwsContext *sws_ctx_;
+    std::unique_ptr<FramePool> pool_;
+    // empty when frames are converted in one piece
+    std::vector<Slice> slices_;
+    std::unique_ptr<ooknn::SliceGroup> slice_group_;
+};
+
+#endif  // __CONVERTER_HPP__
@@ -0,0 +1,138 @@
+#include "demuxer_source.hpp"
+#include "scoped_exit.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavdevice/avdevice.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+#endif
+
+#include <iostream>
+#include <assert.h>
+#include <string>
+
+DemuxerSource::DemuxerSource(const StreamConfig &stream)
+    : format_ctx_(nullptr)
+    , codec_ctx_(nullptr)
+    , codec_(nullptr)
+    , video_stream_(nullptr)
+    , packet_(nullptr)
+{
+    std::cout << "Initialize decoder of the camera " << stream.input << std::endl;
+
+    avdevice_register_all();
+
+    format_ctx_ = avformat_alloc_context();
+    AVInputFormat *inputFormat = av_find_input_format(stream.input_format.c_str());
+    assert(inputFormat);
+    AVDictionary *options = nullptr;
+
+    std::string s = std::to_string(stream.capture_width);
+    s += "x";
+    s += std::to_string(stream.capture_height);
+    av_dict_set(&options, "video_size", s.data(), 0);
+    av_dict_set(&options, "pixel_format", stream.capture_pix_fmt.c_str(), 0);
+    av_dict_set(&options, "framerate", std::to_string(CaptureFpsOf(stream)).c_str(), 0);
+
+    int statCode = avformat_open_input(&format_ctx_, stream.input.c_str(), inputFormat, &options);
+    av_dict_free(&options);
+    assert(statCode == 0);
+
+    statCode = avformat_find_stream_info(format_ctx_, nullptr);
+    assert(statCode >= 0);
+    av_dump_format(format_ctx_, 0, stream.name.c_str(), 0);
+
+    int videoStreamIndex = av_find_best_stream(format_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, &codec_, 0);
+    assert(videoStreamIndex >= 0);
+    assert(codec_);
+    video_stream_ = format_ctx_->streams[videoStreamIndex];
+    codec_ctx_ = avcodec_alloc_context3(codec_);
+    assert(codec_ctx_);
+    statCode = avcodec_parameters_to_context(codec_ctx_, video_stream_->codecpar);
+    assert(statCode >= 0);
+    // frames are decoded on the shared worker pool, extra decoder threads would only oversubscribe it
+    codec_ctx_->thread_count = 1;
+    statCode = avcodec_open2(codec_ctx_, codec_, nullptr);
+    assert(statCode == 0);
+
+    std::cout << "Decoder params: width: " << codec_ctx_->width << ", height: " << codec_ctx_->height << ", pixel_fmt: "
+              << av_get_pix_fmt_name(codec_ctx_->pix_fmt) << ", framerate: " << video_stream_->r_frame_rate.num << std::endl;
+
+    packet_ = av_packet_alloc();
+    av_init_packet(packet_);
+}
+
+DemuxerSource::~DemuxerSource()
+{
+    av_packet_free(&packet_);
+    avcodec_free_context(&codec_ctx_);
+    avformat_close_input(&format_ctx_);
+}
+
+int DemuxerSource::Read(AVFrame *frame, int64_t &captured)
+{
+    int statCode = av_read_frame(format_ctx_, packet_);
+    if (statCode < 0)
+    {
+        return statCode;
+    }
+    captured = av_gettime();
+    auto pkt_clean = make_scoped_exit([&pkt = packet_]() { av_packet_unref(pkt); });
+    if (packet_->stream_index != video_stream_->index)
+    {
+        return 0;
+    }
+    // EAGAIN means the decoder wants more input, not the end
+    statCode = DecodePacketToFrame(frame);
+    return statCode == AVERROR(EAGAIN) ? 0 : statCode;
+}
+
+int DemuxerSource::DecodePacketToFrame(AVFrame *frame)
+{
+    int statCode = avcodec_send_packet(codec_ctx_, packet_);
+    if (statCode < 0)
+    {
+        return statCode;
+    }
+
+    statCode = avcodec_receive_frame(codec_ctx_, frame);
+    if (statCode < 0)
+    {
+        return statCode;
+    }
+    return 1;
+}
+
+int DemuxerSource::Width() const
+{
+    return codec_ctx_->width;
+}
+
+int DemuxerSource::Height() const
+{
+    return codec_ctx_->height;
+}
+
+AVPixelFormat DemuxerSource::Format() const
+{
+    return codec_ctx_->pix_fmt;
+}
+
+AVRational DemuxerSource::FrameRate() const
+{
+    return video_stream_->r_frame_rate;
+}
+
+AVRational DemuxerSource::TimeBase() const
+{
+    return video_stream_->time_base;
+}
+
+AVRational DemuxerSource::SampleAspectRatio() const
+{
+    return video_stream_->sample_aspect_ratio;
+}
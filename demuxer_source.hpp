@@ -0,0 +1,43 @@
+#ifndef __DEMUXER_SOURCE_HPP__
+#define __DEMUXER_SOURCE_HPP__
+
+#include "capture_source.hpp"
+
+struct AVCodec;
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVPacket;
+struct AVStream;
+
+// libavdevice / libavformat input and its decoder: x11grab, v4l2, lavfi,
+// rawvideo files or anything else av_find_input_format knows.
+class DemuxerSource : public CaptureSource
+{
+public:
+    explicit DemuxerSource(const StreamConfig &stream);
+    ~DemuxerSource() override;
+    DemuxerSource(const DemuxerSource &) = delete;
+    DemuxerSource &operator=(const DemuxerSource &) = delete;
+
+    // blocks in av_read_frame until the device delivers the next picture
+    int Read(AVFrame *frame, int64_t &captured) override;
+
+    int Width() const override;
+    int Height() const override;
+    AVPixelFormat Format() const override;
+    AVRational FrameRate() const override;
+    AVRational TimeBase() const override;
+    AVRational SampleAspectRatio() const override;
+
+private:
+    int DecodePacketToFrame(AVFrame *frame);
+
+private:
+    AVFormatContext *format_ctx_;
+    AVCodecContext *codec_ctx_;
+    AVCodec *codec_;
+    AVStream *video_stream_;
+    AVPacket *packet_;
+};
+
+#endif  // __DEMUXER_SOURCE_HPP__
@@ -0,0 +1,322 @@
+// Benchmark: every encoder profile on the same synthetic screen content.
+// Reports encode throughput, CPU time per frame, the luma PSNR of the decoded
+// output and, per frame, the time from avcodec_send_frame until its packet
+// comes out, which is the latency the encoder itself adds. Several encoders,
+// e.g. libx264 and libx265, are compared at the same bitrate.
+//
+//   ./encoder_bench [frames] [width] [height] [fps] [bit_rate] [encoder,encoder...]
+
+#include "encoder_profile.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+#include <libavutil/log.h>
+}
+#endif
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    int frames = 300;
+    int width = 1920;
+    int height = 1080;
+    int fps = 15;
+    int64_t bit_rate = 5000000;
+    std::vector<std::string> encoders = {"libx264", "libx265"};
+};
+
+struct Result
+{
+    double seconds = 0;
+    double cpu_seconds = 0;
+    double psnr = 0;
+    int packets = 0;
+    int64_t bytes = 0;
+    std::vector<double> latency_ms;
+    std::vector<int> delay_frames;
+};
+
+// mostly static desktop: a gradient background, a scrolling text-like band
+// and a small moving window, so both intra and inter paths get work
+void Paint(AVFrame *frame, int index)
+{
+    for (int y = 0; y < frame->height; ++y)
+    {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x)
+        {
+            row[x] = static_cast<uint8_t>(32 + (x + y) / 16);
+        }
+    }
+    int band = frame->height / 3;
+    for (int y = band; y < band + 64 && y < frame->height; ++y)
+    {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x)
+        {
+            row[x] = ((x + index * 4) / 6 + y / 3) % 5 == 0 ? 235 : 16;
+        }
+    }
+    int box = frame->height / 5;
+    int bx = (index * 8) % std::max(1, frame->width - box);
+    int by = frame->height - box - 16;
+    for (int y = by; y < by + box; ++y)
+    {
+        memset(frame->data[0] + y * frame->linesize[0] + bx, 200, static_cast<size_t>(box));
+    }
+    for (int plane = 1; plane < 3; ++plane)
+    {
+        for (int y = 0; y < frame->height / 2; ++y)
+        {
+            memset(frame->data[plane] + y * frame->linesize[plane], plane == 1 ? 110 : 140, static_cast<size_t>(frame->width / 2));
+        }
+    }
+}
+
+double CpuSeconds()
+{
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// decodes the packets and compares the luma plane with the painted source,
+// returns the PSNR over all decoded frames in dB
+double LumaPsnr(AVCodecID id, const Options &opt, const std::vector<AVPacket *> &packets)
+{
+    AVCodec *codec = avcodec_find_decoder(id);
+    if (!codec)
+    {
+        return 0;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (avcodec_open2(ctx, codec, nullptr) < 0)
+    {
+        avcodec_free_context(&ctx);
+        return 0;
+    }
+    AVFrame *decoded = av_frame_alloc();
+    AVFrame *source = av_frame_alloc();
+    source->width = opt.width;
+    source->height = opt.height;
+    source->format = AV_PIX_FMT_YUV420P;
+    av_frame_get_buffer(source, 64);
+
+    double squared = 0;
+    int64_t samples = 0;
+    auto compare = [&]() {
+        while (avcodec_receive_frame(ctx, decoded) == 0)
+        {
+            Paint(source, static_cast<int>(decoded->pts));
+            for (int y = 0; y < opt.height; ++y)
+            {
+                const uint8_t *a = source->data[0] + y * source->linesize[0];
+                const uint8_t *b = decoded->data[0] + y * decoded->linesize[0];
+                for (int x = 0; x < opt.width; ++x)
+                {
+                    int d = a[x] - b[x];
+                    squared += d * d;
+                }
+            }
+            samples += static_cast<int64_t>(opt.width) * opt.height;
+            av_frame_unref(decoded);
+        }
+    };
+    for (auto packet : packets)
+    {
+        avcodec_send_packet(ctx, packet);
+        compare();
+    }
+    avcodec_send_packet(ctx, nullptr);
+    compare();
+
+    av_frame_free(&source);
+    av_frame_free(&decoded);
+    avcodec_free_context(&ctx);
+    if (samples == 0)
+    {
+        return 0;
+    }
+    double mse = squared / static_cast<double>(samples);
+    return mse > 0 ? 10 * std::log10(255.0 * 255.0 / mse) : 99;
+}
+
+bool Run(const EncoderProfile &profile, const std::string &encoder, const Options &opt, Result &r)
+{
+    AVCodec *codec = avcodec_find_encoder_by_name(encoder.c_str());
+    if (!codec)
+    {
+        fprintf(stderr, "encoder %s not found\n", encoder.c_str());
+        return false;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    ctx->width = opt.width;
+    ctx->height = opt.height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->time_base = (AVRational) {1, opt.fps};
+    ctx->framerate = (AVRational) {opt.fps, 1};
+    ctx->gop_size = 250;
+    ctx->thread_count = 0;
+
+    AVDictionary *options = nullptr;
+    ApplyEncoderProfile(profile, opt.bit_rate, opt.fps, ctx, &options);
+    int status = avcodec_open2(ctx, codec, &options);
+    av_dict_free(&options);
+    if (status < 0)
+    {
+        fprintf(stderr, "%s: cannot open encoder\n", profile.name.c_str());
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    frame->width = opt.width;
+    frame->height = opt.height;
+    frame->format = AV_PIX_FMT_YUV420P;
+    av_frame_get_buffer(frame, 64);
+    AVPacket *packet = av_packet_alloc();
+
+    std::vector<Clock::time_point> sent(static_cast<size_t>(opt.frames));
+    // kept for the PSNR pass, which runs after the timed loop
+    std::vector<AVPacket *> packets;
+    int submitted = 0;
+    auto drain = [&]() {
+        while (avcodec_receive_packet(ctx, packet) == 0)
+        {
+            auto now = Clock::now();
+            if (packet->pts >= 0 && packet->pts < opt.frames)
+            {
+                r.latency_ms.push_back(std::chrono::duration<double, std::milli>(now - sent[static_cast<size_t>(packet->pts)]).count());
+                r.delay_frames.push_back(submitted - 1 - static_cast<int>(packet->pts));
+            }
+            ++r.packets;
+            r.bytes += packet->size;
+            packets.push_back(av_packet_clone(packet));
+            av_packet_unref(packet);
+        }
+    };
+
+    double cpu_begin = CpuSeconds();
+    auto begin = Clock::now();
+    for (int i = 0; i < opt.frames; ++i)
+    {
+        av_frame_make_writable(frame);
+        Paint(frame, i);
+        frame->pts = i;
+        sent[static_cast<size_t>(i)] = Clock::now();
+        avcodec_send_frame(ctx, frame);
+        ++submitted;
+        drain();
+    }
+    avcodec_send_frame(ctx, nullptr);
+    drain();
+    r.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    r.cpu_seconds = CpuSeconds() - cpu_begin;
+    r.psnr = LumaPsnr(ctx->codec_id, opt, packets);
+    for (auto &p : packets)
+    {
+        av_packet_free(&p);
+    }
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return true;
+}
+
+void Report(const EncoderProfile &profile, const std::string &encoder, const Options &opt, Result &r)
+{
+    std::sort(r.latency_ms.begin(), r.latency_ms.end());
+    auto pct = [&r](double p) -> double {
+        if (r.latency_ms.empty())
+        {
+            return 0;
+        }
+        return r.latency_ms[std::min(r.latency_ms.size() - 1, static_cast<size_t>(p * static_cast<double>(r.latency_ms.size())))];
+    };
+    double delay = 0;
+    for (int d : r.delay_frames)
+    {
+        delay += d;
+    }
+    delay = r.delay_frames.empty() ? 0 : delay / static_cast<double>(r.delay_frames.size());
+    double kbps = static_cast<double>(r.bytes) * 8 / (static_cast<double>(opt.frames) / opt.fps) / 1000;
+    printf("%-8s %-20s %8.1f fps  cpu %6.2f ms/frame  p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  delay %5.2f frames  %8.0f kbps  psnr-y %5.2f dB\n",
+           encoder.c_str(),
+           profile.name.c_str(),
+           static_cast<double>(opt.frames) / r.seconds,
+           r.cpu_seconds * 1000 / static_cast<double>(opt.frames),
+           pct(0.50),
+           pct(0.99),
+           r.latency_ms.empty() ? 0 : r.latency_ms.back(),
+           delay,
+           kbps,
+           r.psnr);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (argc > 1)
+        opt.frames = std::max(1, atoi(argv[1]));
+    if (argc > 2)
+        opt.width = atoi(argv[2]) & ~1;
+    if (argc > 3)
+        opt.height = atoi(argv[3]) & ~1;
+    if (argc > 4)
+        opt.fps = std::max(1, atoi(argv[4]));
+    if (argc > 5)
+        opt.bit_rate = atoll(argv[5]);
+    if (argc > 6)
+    {
+        opt.encoders.clear();
+        std::istringstream list(argv[6]);
+        std::string name;
+        while (std::getline(list, name, ','))
+        {
+            opt.encoders.push_back(name);
+        }
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    printf("%dx%d @ %d fps, %lld bps, %d frames\n", opt.width, opt.height, opt.fps, static_cast<long long>(opt.bit_rate), opt.frames);
+    for (const auto &profile : EncoderProfiles())
+    {
+        printf("  %s\n", DescribeEncoderProfile(profile).c_str());
+    }
+
+    for (const auto &encoder : opt.encoders)
+    {
+        for (const auto &profile : EncoderProfiles())
+        {
+            Result r;
+            if (Run(profile, encoder, opt, r))
+            {
+                Report(profile, encoder, opt, r);
+            }
+        }
+    }
+    return 0;
+}
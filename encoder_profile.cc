@@ -0,0 +1,119 @@
+#include "encoder_profile.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+}
+#endif
+
+#include <sstream>
+
+const std::vector<EncoderProfile> &EncoderProfiles()
+{
+    using RC = EncoderProfile::RateControl;
+    static const std::vector<EncoderProfile> profiles = {
+        // interactive viewing: no lookahead or B-frames, sliced threads, a 250 ms VBV
+        {"zerolatency-screen", "superfast", "zerolatency", 0, 0, 0, true, false, RC::Cbr, 250, 0},
+        // as above, but without IDR spikes; a joining viewer needs up to one GOP to get a full picture
+        {"zerolatency-refresh", "superfast", "zerolatency", 0, 0, 0, true, true, RC::Cbr, 250, 0},
+        // recording: B-frames, lookahead and frame threads, constant quality, rare keyframes
+        {"quality-archive", "medium", "", 10, 3, 40, false, false, RC::Crf, 0, 20},
+        // many streams on a small box: cheapest preset, one second VBV
+        {"low-cpu", "ultrafast", "zerolatency", 0, 0, 0, true, false, RC::Vbr, 1000, 0},
+    };
+    return profiles;
+}
+
+const EncoderProfile *FindEncoderProfile(const std::string &name)
+{
+    for (const auto &profile : EncoderProfiles())
+    {
+        if (profile.name == name)
+        {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+void ApplyEncoderProfile(const EncoderProfile &profile, int64_t bit_rate, int fps, AVCodecContext *ctx, AVDictionary **options)
+{
+    av_dict_set(options, "preset", profile.preset.c_str(), 0);
+    if (!profile.tune.empty())
+    {
+        av_dict_set(options, "tune", profile.tune.c_str(), 0);
+    }
+    if (profile.gop_seconds > 0)
+    {
+        ctx->gop_size = profile.gop_seconds * fps;
+    }
+    ctx->max_b_frames = profile.b_frames;
+    ctx->thread_type = profile.slice_threads ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+    if (ctx->codec_id == AV_CODEC_ID_HEVC)
+    {
+        // libx265 has no AVOptions for these, they go through x265-params;
+        // frame threads add a frame of delay each, x265 has no slice threads
+        std::ostringstream params;
+        params << "rc-lookahead=" << profile.rc_lookahead << ":bframes=" << profile.b_frames;
+        if (profile.slice_threads)
+        {
+            params << ":frame-threads=1";
+        }
+        if (profile.intra_refresh)
+        {
+            params << ":intra-refresh=1";
+        }
+        av_dict_set(options, "x265-params", params.str().c_str(), 0);
+        // a requested key frame must be an IDR for a joining viewer, not a CRA
+        av_dict_set(options, "forced-idr", "1", 0);
+    }
+    else
+    {
+        av_dict_set_int(options, "rc-lookahead", profile.rc_lookahead, 0);
+        if (profile.intra_refresh)
+        {
+            av_dict_set(options, "intra-refresh", "1", 0);
+        }
+    }
+
+    int64_t vbv_bits = bit_rate * profile.vbv_ms / 1000;
+    switch (profile.rate_control)
+    {
+        case EncoderProfile::RateControl::Cbr:
+            ctx->bit_rate = bit_rate;
+            ctx->rc_max_rate = bit_rate;
+            ctx->rc_buffer_size = static_cast<int>(vbv_bits);
+            break;
+        case EncoderProfile::RateControl::Vbr:
+            ctx->bit_rate = bit_rate;
+            ctx->rc_max_rate = bit_rate * 3 / 2;
+            ctx->rc_buffer_size = static_cast<int>(vbv_bits * 3 / 2);
+            break;
+        case EncoderProfile::RateControl::Crf:
+            ctx->bit_rate = 0;
+            av_dict_set_int(options, "crf", profile.crf, 0);
+            break;
+    }
+}
+
+std::string DescribeEncoderProfile(const EncoderProfile &profile)
+{
+    static const char *rc_names[] = {"cbr", "vbr", "crf"};
+    std::ostringstream out;
+    out << profile.name << ": preset=" << profile.preset << " tune=" << (profile.tune.empty() ? "none" : profile.tune)
+        << " gop=" << (profile.gop_seconds > 0 ? std::to_string(profile.gop_seconds) + "s" : std::string("stream"))
+        << " bframes=" << profile.b_frames << " lookahead=" << profile.rc_lookahead
+        << " threads=" << (profile.slice_threads ? "slice" : "frame")
+        << " refresh=" << (profile.intra_refresh ? "intra" : "idr")
+        << " rc=" << rc_names[static_cast<int>(profile.rate_control)];
+    if (profile.rate_control == EncoderProfile::RateControl::Crf)
+    {
+        out << " crf=" << profile.crf;
+    }
+    else
+    {
+        out << " vbv=" << profile.vbv_ms << "ms";
+    }
+    return out.str();
+}
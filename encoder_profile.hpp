@@ -0,0 +1,50 @@
+#ifndef __ENCODER_PROFILE_HPP__
+#define __ENCODER_PROFILE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVCodecContext;
+struct AVDictionary;
+
+// Named set of encoder settings, selected per stream with encoder_profile.
+// Options are given the libx264 way; encoders that do not know one leave it
+// unconsumed and it is logged at open time.
+struct EncoderProfile
+{
+    enum class RateControl
+    {
+        Cbr,  // bit_rate with max rate = bit_rate and a VBV of vbv_ms
+        Vbr,  // bit_rate average, peaks up to 1.5x within vbv_ms
+        Crf,  // constant quality, bit_rate is ignored
+    };
+
+    std::string name;
+    std::string preset;
+    std::string tune;  // empty: none
+    // keyframe interval in seconds, 0 keeps the stream's gop
+    int gop_seconds;
+    int b_frames;
+    int rc_lookahead;
+    // slice threads add no delay, frame threads add one frame per thread
+    bool slice_threads;
+    // spread intra refresh over the GOP instead of sending IDR frames
+    bool intra_refresh;
+    RateControl rate_control;
+    int vbv_ms;
+    int crf;
+};
+
+const std::vector<EncoderProfile> &EncoderProfiles();
+// nullptr if there is no profile called `name`
+const EncoderProfile *FindEncoderProfile(const std::string &name);
+
+// Sets up `ctx` and the private options in `options` (passed to
+// avcodec_open2) for a stream of `bit_rate` bps at `fps`.
+void ApplyEncoderProfile(const EncoderProfile &profile, int64_t bit_rate, int fps, AVCodecContext *ctx, AVDictionary **options);
+
+// one line summary for the startup log
+std::string DescribeEncoderProfile(const EncoderProfile &profile);
+
+#endif  // __ENCODER_PROFILE_HPP__
@@ -0,0 +1,44 @@
+#include "frame_pacer.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+#endif
+
+FramePacer::FramePacer(AVRational fps, AVRational time_base)
+    : slot_base_(av_inv_q(fps))
+    , time_base_(time_base)
+    , first_pts_(AV_NOPTS_VALUE)
+    , next_slot_(0)
+    , dropped_(0)
+{
+}
+
+bool FramePacer::Accept(int64_t pts, int64_t &slot)
+{
+    if (pts == AV_NOPTS_VALUE)
+    {
+        slot = next_slot_++;
+        return true;
+    }
+    if (first_pts_ == AV_NOPTS_VALUE)
+    {
+        first_pts_ = pts;
+    }
+    int64_t nearest = av_rescale_q_rnd(pts - first_pts_, time_base_, slot_base_, static_cast<AVRounding>(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
+    if (nearest < next_slot_)
+    {
+        ++dropped_;
+        return false;
+    }
+    slot = nearest;
+    next_slot_ = nearest + 1;
+    return true;
+}
+
+uint64_t FramePacer::Dropped() const
+{
+    return dropped_;
+}
@@ -0,0 +1,39 @@
+#ifndef __FRAME_PACER_HPP__
+#define __FRAME_PACER_HPP__
+
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/rational.h>
+}
+#endif
+
+// Frame rate conversion without libavfilter. Maps the timestamps of captured
+// frames to slots of the output rate, rounding to the nearest one like the
+// fps filter: the first frame of a slot is kept, later ones in the same slot
+// are dropped. Missing slots are not filled with duplicates, the gap shows up
+// in the pts and the encoder output is variable rate, as with skip_static.
+//
+// When the source is read at the output rate to begin with, every frame gets
+// its own slot and nothing is copied or dropped.
+class FramePacer
+{
+public:
+    // `fps` of the output, `time_base` of the source's pts
+    FramePacer(AVRational fps, AVRational time_base);
+
+    // true if a frame with `pts` opens a new slot, returned in `slot` as the
+    // output pts in 1/fps units; AV_NOPTS_VALUE takes the next slot
+    bool Accept(int64_t pts, int64_t &slot);
+    uint64_t Dropped() const;
+
+private:
+    AVRational slot_base_;
+    AVRational time_base_;
+    int64_t first_pts_;
+    int64_t next_slot_;
+    uint64_t dropped_;
+};
+
+#endif  // __FRAME_PACER_HPP__
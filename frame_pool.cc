@@ -0,0 +1,101 @@
+#include "frame_pool.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+}
+#endif
+
+#include <algorithm>
+#include <assert.h>
+#include <cstdlib>
+#include <vector>
+
+// buffer base, plane offsets and line sizes, a cache line and the widest SIMD loads on the planes
+#define FRAME_POOL_ALIGN 64
+
+FramePool::FramePool(int width, int height, AVPixelFormat format, size_t size)
+    : width_(width)
+    , height_(height)
+    , format_(format)
+    , size_(size)
+    , buffer_size_(av_image_get_buffer_size(format, width, height, FRAME_POOL_ALIGN))
+    , pool_(nullptr)
+    , acquired_(0)
+    , allocated_(0)
+{
+    assert(buffer_size_ > 0);
+    pool_ = av_buffer_pool_init2(buffer_size_, this, &FramePool::Allocate, nullptr);
+    assert(pool_);
+
+    // fault every buffer in up front so the capture thread never sees a page fault
+    std::vector<AVBufferRef *> warm(size_);
+    for (auto &buf : warm)
+    {
+        buf = av_buffer_pool_get(pool_);
+        assert(buf);
+        std::fill(buf->data, buf->data + buf->size, 0);
+    }
+    for (auto &buf : warm)
+    {
+        av_buffer_unref(&buf);
+    }
+    allocated_.store(0);
+}
+
+FramePool::~FramePool()
+{
+    // buffers still referenced by queued frames keep the pool alive until released
+    av_buffer_pool_uninit(&pool_);
+}
+
+AVBufferRef *FramePool::Allocate(void *opaque, int size)
+{
+    auto self = static_cast<FramePool *>(opaque);
+    self->allocated_.fetch_add(1, std::memory_order_relaxed);
+    // av_malloc aligns to what FFmpeg was configured for, possibly less
+    size_t padded = (static_cast<size_t>(size) + FRAME_POOL_ALIGN - 1) / FRAME_POOL_ALIGN * FRAME_POOL_ALIGN;
+    auto data = static_cast<uint8_t *>(aligned_alloc(FRAME_POOL_ALIGN, padded));
+    if (!data)
+    {
+        return nullptr;
+    }
+    AVBufferRef *buf = av_buffer_create(data, size, &FramePool::Free, nullptr, 0);
+    if (!buf)
+    {
+        free(data);
+    }
+    return buf;
+}
+
+void FramePool::Free(void *, uint8_t *data)
+{
+    free(data);
+}
+
+AVFrame *FramePool::Acquire()
+{
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->width = width_;
+    frame->height = height_;
+    frame->format = format_;
+    frame->buf[0] = av_buffer_pool_get(pool_);
+    assert(frame->buf[0]);
+    int statCode = av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, format_, width_, height_, FRAME_POOL_ALIGN);
+    assert(statCode >= 0);
+    acquired_.fetch_add(1, std::memory_order_relaxed);
+    return frame;
+}
+
+uint64_t FramePool::Hits() const
+{
+    return acquired_.load(std::memory_order_relaxed) - allocated_.load(std::memory_order_relaxed);
+}
+
+uint64_t FramePool::Misses() const
+{
+    return allocated_.load(std::memory_order_relaxed);
+}
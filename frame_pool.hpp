@@ -0,0 +1,59 @@
+#ifndef __FRAME_POOL_HPP__
+#define __FRAME_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+struct AVFrame;
+struct AVBufferPool;
+struct AVBufferRef;
+
+// Picture buffers for one frame geometry, `size` of them allocated and
+// faulted in up front. Frames handed out by Acquire() return their buffer to
+// the pool once the last reference is dropped (typically by the encoder
+// thread). While no more than `size` are in flight no picture is allocated,
+// only the AVFrame itself; every miss adds a buffer that the pool keeps, so
+// it grows to the peak number in flight and Misses() shows by how much.
+class FramePool
+{
+public:
+    FramePool(int width, int height, AVPixelFormat format, size_t size);
+    ~FramePool();
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // new refcounted frame in a fresh AVFrame, caller owns it (av_frame_free)
+    AVFrame *Acquire();
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    AVPixelFormat Format() const { return format_; }
+    size_t Size() const { return size_; }
+    // acquisitions served by a recycled buffer
+    uint64_t Hits() const;
+    // acquisitions that had to allocate because every pooled buffer was in flight
+    uint64_t Misses() const;
+
+private:
+    static AVBufferRef *Allocate(void *opaque, int size);
+    static void Free(void *opaque, uint8_t *data);
+
+private:
+    int width_;
+    int height_;
+    AVPixelFormat format_;
+    size_t size_;
+    int buffer_size_;
+    AVBufferPool *pool_;
+    std::atomic<uint64_t> acquired_;
+    std::atomic<uint64_t> allocated_;
+};
+
+#endif  // __FRAME_POOL_HPP__
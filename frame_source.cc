@@ -1,122 +1,168 @@
-#include "codec.hpp"
+#include "rendition.hpp"
 #include "frame_source.hpp"
+#include "client_source.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/time.h>
+}
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <iostream>
 #include <assert.h>
 #include <mutex>
 
-RecordFrameSource *RecordFrameSource::createNew(UsageEnvironment &env, RecordCodecPtr codecer)
+// NALs and bytes held for the clients: the current GOP plus the backlog of
+// clients within their latency budget
+#define FANOUT_RING_SLOTS 8192
+#define FANOUT_RING_BYTES (64 * 1024 * 1024)
+
+RecordFrameSource *RecordFrameSource::createNew(UsageEnvironment &env, RenditionPtr rendition)
 {
-    return new RecordFrameSource(env, codecer);
+    return new RecordFrameSource(env, rendition);
 }
 
-RecordFrameSource::RecordFrameSource(UsageEnvironment &env, RecordCodecPtr codecer)
-    : FramedSource(env)
-    , codecer_(codecer)
+RecordFrameSource::RecordFrameSource(UsageEnvironment &env, RenditionPtr rendition)
+    : Medium(env)
+    , rendition_(rendition)
     , event_id_(0)
+    , ring_(rendition->Codec(), FANOUT_RING_SLOTS, FANOUT_RING_BYTES)
     , max_nalu_size_(0)
+    , dropped_frames_(0)
+    , dropped_bytes_(0)
+    , summary_dropped_(0)
+    , last_delivered_pts_(INT64_MIN)
+    , packetize_clock_("packetize")
 {
 
     event_id_ = envir().taskScheduler().createEventTrigger(RecordFrameSource::DeliverFrame0);
     assert(event_id_ != 0);
-    buffer_.reserve(5);
-    codecer_->SetOnEncodedDataCallback(std::bind(&RecordFrameSource::OnEncodedData, this, std::placeholders::_1));
-    std::cout << "Starting to capture and encode video from the camera: " << codecer_->RtspUrl() << std::endl;
-
-    std::thread([&codecer = codecer_]() { codecer->Run(); }).detach();
+    rendition_->SetOnEncodedDataCallback(std::bind(&RecordFrameSource::OnEncodedData, this, std::placeholders::_1));
+    std::cout << "Delivering encoded video of " << rendition_->Name() << std::endl;
 }
 
 RecordFrameSource::~RecordFrameSource()
 {
-    codecer_->Stop();
+    // the owning RecordCodec has been stopped, no callback is in flight anymore
     envir().taskScheduler().deleteEventTrigger(event_id_);
     event_id_ = 0;
     buffer_.clear();
-    std::cout << codecer_->Name() << ":max NALU size: " << max_nalu_size_ << std::endl;
+    std::cout << rendition_->Name() << ":max NALU size: " << max_nalu_size_ << std::endl;
+    std::cout << rendition_->Name() << ":dropped frames: " << dropped_frames_ << ", dropped bytes: " << dropped_bytes_ << std::endl;
 }
 
-void RecordFrameSource::OnEncodedData(std::vector<uint8_t> &&newData)
+const std::string &RecordFrameSource::Name() const
 {
+    return rendition_->Name();
+}
 
-    if (!isCurrentlyAwaitingData())
-    {
-        return;
-    }
-
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        buffer_.emplace_back(std::move(newData));
-    }
-
-    envir().taskScheduler().triggerEvent(event_id_, this);
+const StreamConfig &RecordFrameSource::Stream() const
+{
+    return rendition_->Stream();
 }
 
-void RecordFrameSource::DeliverFrame0(void *clientData)
+void RecordFrameSource::RequestKeyFrame()
 {
-    ((RecordFrameSource *)clientData)->DeliverData();
+    rendition_->RequestKeyFrame();
 }
 
-void RecordFrameSource::doStopGettingFrames()
+void RecordFrameSource::AddClient(ClientFrameSource *client)
 {
+    clients_.push_back(client);
+}
 
-    std::cout << "Stop getting frames from the camera: " << codecer_->Name() << std::endl;
-    FramedSource::doStopGettingFrames();
+void RecordFrameSource::RemoveClient(ClientFrameSource *client)
+{
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), client), clients_.end());
 }
 
-void RecordFrameSource::DeliverData()
+void RecordFrameSource::CountDropped(uint64_t frames, uint64_t bytes)
 {
+    dropped_frames_ += frames;
+    dropped_bytes_ += bytes;
+}
 
-    if (!isCurrentlyAwaitingData())
-    {
-        return;
-    }
+void RecordFrameSource::RecordJoin(int64_t us, bool primed)
+{
+    (primed ? primed_joins_ : cold_joins_).Record(us);
+}
 
-    {
-        std::lock_guard<std::mutex> mu(mutex_);
-        if (buffer_.empty())
-        {
-            return;
-        }
+std::string RecordFrameSource::Summary()
+{
+    char line[320];
+    snprintf(line, sizeof(line), "%zu clients, ring %zu NALs/%zu KiB, %llu frames skipped for slow clients, time to first frame primed %.1f/%.1f/%.1f (%llu joins), cold %.1f/%.1f/%.1f (%llu joins) ms (p50/p99/max)",
+             clients_.size(), ring_.Size(), ring_.Bytes() / 1024,
+             static_cast<unsigned long long>(dropped_frames_ - summary_dropped_),
+             primed_joins_.Percentile(0.50) / 1000.0, primed_joins_.Percentile(0.99) / 1000.0, primed_joins_.Max() / 1000.0,
+             static_cast<unsigned long long>(primed_joins_.Count()),
+             cold_joins_.Percentile(0.50) / 1000.0, cold_joins_.Percentile(0.99) / 1000.0, cold_joins_.Max() / 1000.0,
+             static_cast<unsigned long long>(cold_joins_.Count()));
+    summary_dropped_ = dropped_frames_;
+    primed_joins_.Reset();
+    cold_joins_.Reset();
+    return line;
+}
 
-        data_ = std::move(buffer_.back());
+ooknn::StageClock &RecordFrameSource::PacketizeClock()
+{
+    return packetize_clock_;
+}
 
-        buffer_.pop_back();
-    }
+void RecordFrameSource::OnEncodedData(PacketView &&newData)
+{
 
-    if (data_.size() > max_nalu_size_)
     {
-        max_nalu_size_ = data_.size();
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_.push_back(std::move(newData));
     }
 
-    if (data_.size() > fMaxSize)
-    {
+    envir().taskScheduler().triggerEvent(event_id_, this);
+}
 
-        std::cout << "Exceeded max size, truncated: " << fNumTruncatedBytes << ", size: " << data_.size();
-        std::cout << "\n";
+void RecordFrameSource::DeliverFrame0(void *clientData)
+{
+    ((RecordFrameSource *)clientData)->DeliverData();
+}
 
-        fFrameSize = fMaxSize;
+// Runs on the live555 thread. Everything the encoder produced goes into the
+// ring whether or not a client keeps up, slow clients skip ahead on their own.
+void RecordFrameSource::DeliverData()
+{
 
-        fNumTruncatedBytes = static_cast<unsigned int>(data_.size() - fMaxSize);
+    std::deque<PacketView> data;
+    {
+        std::lock_guard<std::mutex> mu(mutex_);
+        data.swap(buffer_);
     }
-    else
+    if (data.empty())
     {
-        fFrameSize = static_cast<unsigned int>(data_.size());
+        return;
     }
+    ooknn::StageStep step(packetize_clock_);
 
-    gettimeofday(&fPresentationTime, nullptr);
-    memcpy(fTo, data_.data(), fFrameSize);
-    FramedSource::afterGetting(this);
-}
-
-void RecordFrameSource::doGetNextFrame()
-{
-
-    if (!buffer_.empty())
+    int64_t now = av_gettime();
+    for (auto &nal : data)
     {
-        DeliverData();
+        if (nal.Size() > max_nalu_size_)
+        {
+            max_nalu_size_ = nal.Size();
+        }
+        if (nal.EncodeTime() && nal.Pts() != last_delivered_pts_)
+        {
+            // once per access unit, at its first NAL
+            rendition_->Latency().Record(StageLatency::Deliver, now - nal.EncodeTime());
+            rendition_->Latency().Record(StageLatency::Total, now - nal.Time());
+            last_delivered_pts_ = nal.Pts();
+        }
+        ring_.Push(std::move(nal), now);
     }
-    else
+
+    // a client may go away while being served, so no iterators
+    for (size_t i = 0; i < clients_.size(); ++i)
     {
-        fFrameSize = 0;
-        return;
+        clients_[i]->OnData();
     }
 }
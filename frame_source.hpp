@@ -1,36 +1,75 @@
 #ifndef __FRAME_SOURCE_HPP__
 #define __FRAME_SOURCE_HPP__
 
-#include <FramedSource.hh>
+#include "broadcast_ring.hpp"
+#include "latency_stats.hpp"
+#include "packet_view.hpp"
+#include "stage_clock.hpp"
+#include <Media.hh>
 #include <UsageEnvironment.hh>
+#include <cstdint>
+#include <deque>
 #include <mutex>
-#include <thread>
+#include <string>
 #include <vector>
 
-class RecordCodec;
-using RecordCodecPtr = RecordCodec *;
+class ClientFrameSource;
+class Rendition;
+struct StreamConfig;
+using RenditionPtr = Rendition *;
 
-class RecordFrameSource : public FramedSource
+// Hands the encoded NALs of one rendition from the encode strand to the
+// live555 thread and publishes them in a BroadcastRing that all RTSP clients
+// of the rendition read through their ClientFrameSource. The ring also keeps
+// the current GOP, so a joining client can start at its IDR.
+class RecordFrameSource : public Medium
 {
 public:
-    static RecordFrameSource *createNew(UsageEnvironment &env, RecordCodecPtr);
+    static RecordFrameSource *createNew(UsageEnvironment &env, RenditionPtr);
+
+    const std::string &Name() const;
+    const StreamConfig &Stream() const;
+    const BroadcastRing &Ring() const { return ring_; }
+    void RequestKeyFrame();
+
+    // clients are woken up whenever new NALs are in the ring
+    void AddClient(ClientFrameSource *);
+    void RemoveClient(ClientFrameSource *);
+    // a client skipped ahead to the next IDR
+    void CountDropped(uint64_t frames, uint64_t bytes);
+    // time from a client's first frame request to its first IDR slice, with
+    // `primed` telling whether that IDR came from the ring's current GOP
+    void RecordJoin(int64_t us, bool primed);
+
+    // clients, ring use, frames skipped for slow clients and time to first
+    // frame of primed and cold joins since the previous call
+    std::string Summary();
+    // time the live555 thread spends putting this rendition's NALs into the
+    // ring and handing them to the clients' framers and RTP sinks
+    ooknn::StageClock &PacketizeClock();
 
 protected:
-    RecordFrameSource(UsageEnvironment &env, RecordCodecPtr);
+    RecordFrameSource(UsageEnvironment &env, RenditionPtr);
     ~RecordFrameSource() override;
-    void doGetNextFrame() override;
-    void doStopGettingFrames() override;
 
 private:
-    using EncodeData = std::vector<uint8_t>;
-    using EncodeDataBuffer = std::vector<EncodeData>;
-    RecordCodec *codecer_;
+    Rendition *rendition_;
     EventTriggerId event_id_;
     std::mutex mutex_;
-    EncodeDataBuffer buffer_;
-    EncodeData data_;
+    // encode strand -> live555 thread
+    std::deque<PacketView> buffer_;
+    BroadcastRing ring_;
+    std::vector<ClientFrameSource *> clients_;
     size_t max_nalu_size_;
-    void OnEncodedData(std::vector<uint8_t> &&data);
+    uint64_t dropped_frames_;
+    uint64_t dropped_bytes_;
+    uint64_t summary_dropped_;
+    // pts of the last access unit whose delivery latency was recorded
+    int64_t last_delivered_pts_;
+    ooknn::LatencyHistogram primed_joins_;
+    ooknn::LatencyHistogram cold_joins_;
+    ooknn::StageClock packetize_clock_;
+    void OnEncodedData(PacketView &&data);
     void DeliverData();
     static void DeliverFrame0(void *);
 };
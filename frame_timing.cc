@@ -0,0 +1,37 @@
+#include "frame_timing.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+void SetFrameTiming(AVFrame *frame, const FrameTiming &timing)
+{
+    // a timing no clone shares is overwritten, other frames take a pooled
+    // buffer: this runs several times per frame on every stage
+    if (!frame->opaque_ref || !av_buffer_is_writable(frame->opaque_ref) ||
+        frame->opaque_ref->size < static_cast<int>(sizeof(FrameTiming)))
+    {
+        // never uninitialized, frames in flight at exit still return their buffers to it
+        static AVBufferPool *pool = av_buffer_pool_init(sizeof(FrameTiming), nullptr);
+        av_buffer_unref(&frame->opaque_ref);
+        frame->opaque_ref = av_buffer_pool_get(pool);
+        assert(frame->opaque_ref);
+    }
+    memcpy(frame->opaque_ref->data, &timing, sizeof(FrameTiming));
+}
+
+bool GetFrameTiming(const AVFrame *frame, FrameTiming &timing)
+{
+    if (!frame->opaque_ref || frame->opaque_ref->size < static_cast<int>(sizeof(FrameTiming)))
+    {
+        return false;
+    }
+    memcpy(&timing, frame->opaque_ref->data, sizeof(FrameTiming));
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef __FRAME_TIMING_HPP__
+#define __FRAME_TIMING_HPP__
+
+#include <cstdint>
+
+struct AVFrame;
+
+// Wallclock (av_gettime, microseconds) of one captured frame at each shared
+// stage. Travels in AVFrame::opaque_ref, which the filter graph, av_frame_clone
+// and av_frame_copy_props all carry along.
+struct FrameTiming
+{
+    int64_t captured = 0;   // av_read_frame returned it
+    int64_t decoded = 0;    // out of the input decoder
+    int64_t filtered = 0;   // left rate conversion
+    int64_t converted = 0;  // color converted and handed to the renditions
+};
+
+// sets the timing of `frame`; clones made earlier keep theirs, a buffer they
+// share is replaced rather than written
+void SetFrameTiming(AVFrame *frame, const FrameTiming &timing);
+// false if the frame carries no timing
+bool GetFrameTiming(const AVFrame *frame, FrameTiming &timing);
+
+#endif  // __FRAME_TIMING_HPP__
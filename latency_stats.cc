@@ -0,0 +1,106 @@
+#include "latency_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+ooknn::LatencyHistogram::LatencyHistogram()
+    : count_(0)
+    , max_(0)
+{
+    Reset();
+}
+
+size_t ooknn::LatencyHistogram::Bucket(uint64_t us)
+{
+    if (us < 4)
+    {
+        return static_cast<size_t>(us);
+    }
+    // e = floor(log2(us)) >= 2, the two bits below the leading one pick the quarter
+    size_t e = 63 - static_cast<size_t>(__builtin_clzll(us));
+    size_t index = 4 * (e - 1) + ((us >> (e - 2)) & 3);
+    return std::min(index, BUCKETS - 1);
+}
+
+int64_t ooknn::LatencyHistogram::BucketFloor(size_t index)
+{
+    if (index < 4)
+    {
+        return static_cast<int64_t>(index);
+    }
+    size_t e = index / 4 + 1;
+    return static_cast<int64_t>((4 + index % 4) << (e - 2));
+}
+
+void ooknn::LatencyHistogram::Record(int64_t us)
+{
+    us = std::max<int64_t>(us, 0);
+    buckets_[Bucket(static_cast<uint64_t>(us))].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t ooknn::LatencyHistogram::Count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+int64_t ooknn::LatencyHistogram::Percentile(double p) const
+{
+    uint64_t count = Count();
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = std::min(count - 1, static_cast<uint64_t>(p * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+        {
+            return BucketFloor(i);
+        }
+    }
+    return Max();
+}
+
+int64_t ooknn::LatencyHistogram::Max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+void ooknn::LatencyHistogram::Reset()
+{
+    for (auto &b : buckets_)
+    {
+        b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+const char *StageLatency::Name(Stage stage)
+{
+    static const char *names[STAGES] = {"decode", "filter", "convert", "queue", "scale", "encode", "deliver", "total"};
+    return names[stage];
+}
+
+std::string StageLatency::Summary()
+{
+    std::string out;
+    char line[128];
+    for (int i = 0; i < STAGES; ++i)
+    {
+        auto &h = stages[i];
+        snprintf(line, sizeof(line), "%s%s %.1f/%.1f/%.1f", i ? ", " : "", Name(static_cast<Stage>(i)),
+                 h.Percentile(0.50) / 1000.0, h.Percentile(0.99) / 1000.0, h.Max() / 1000.0);
+        out += line;
+        h.Reset();
+    }
+    out += " ms (p50/p99/max)";
+    return out;
+}
@@ -0,0 +1,65 @@
+#ifndef __LATENCY_STATS_HPP__
+#define __LATENCY_STATS_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ooknn
+{
+// Lock-free latency histogram in microseconds. Buckets are log-linear, four
+// per power of two, so percentiles are within 25% over 1 us .. hours.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS = 128;
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    // safe from any thread; negative values (clock steps) are counted as 0
+    void Record(int64_t us);
+    uint64_t Count() const;
+    // lower bound of the bucket holding the p-th percentile, 0 <= p <= 1
+    int64_t Percentile(double p) const;
+    int64_t Max() const;
+    void Reset();
+
+private:
+    static size_t Bucket(uint64_t us);
+    static int64_t BucketFloor(size_t index);
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<int64_t> max_;
+};
+}  // namespace ooknn
+
+// Per-rendition latency of every pipeline stage, all in wallclock microseconds.
+struct StageLatency
+{
+    enum Stage
+    {
+        Decode,   // capture -> decoded
+        Filter,   // -> out of rate conversion
+        Convert,  // -> color converted
+        Queue,    // -> taken from the rendition queue
+        Scale,    // -> resized for the rendition
+        Encode,   // -> packet out of the encoder
+        Deliver,  // -> handed to live555
+        Total,    // capture -> handed to live555
+        STAGES,
+    };
+
+    static const char *Name(Stage stage);
+    void Record(Stage stage, int64_t us) { stages[stage].Record(us); }
+    // "filter p50/p99/max ..." in milliseconds, then resets the histograms
+    std::string Summary();
+
+    ooknn::LatencyHistogram stages[STAGES];
+};
+
+#endif  // __LATENCY_STATS_HPP__
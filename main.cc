@@ -1,7 +1,14 @@
 #include "rtsp_server.hpp"
 #include "codec.hpp"
+#include "config.hpp"
+#include "worker_pool.hpp"
+#include <pthread.h>
+#include <atomic>
 #include <csignal>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -22,20 +29,61 @@ int main(int argc, char **argv)
     std::signal(SIGINT, signal_handler);
 
 
+    ServerConfig config;
+    if (!ParseCommandLine(argc, argv, config))
+    {
+        return 1;
+    }
+
     av_log_set_level(AV_LOG_INFO);
 
-    RecordCodec record("record", ":0.0");
+    // SIGUSR1 saves a clip of every stream. It is blocked before any thread
+    // exists, so only the clip thread below ever receives it.
+    sigset_t clip_signals;
+    sigemptyset(&clip_signals);
+    sigaddset(&clip_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &clip_signals, nullptr);
+
+    // outlives the codecs, their steps run on it
+    ooknn::WorkerPool pool(config.workers, config.worker_cpus);
+
+    std::vector<std::unique_ptr<RecordCodec>> codecs;
+    for (const auto &stream : config.streams)
+    {
+        codecs.push_back(std::make_unique<RecordCodec>(stream, pool));
+    }
 
-    RecordRtspServer server;
+    RecordRtspServer server(config.port);
+    server.SetStatsInterval(config.stats_interval);
+    server.SetRtpSend(config.rtp_send);
 
     shutdown_handler = [&server](int signal) {
         std::cout << "Terminating server..." << std::endl;
         server.StopServer();
     };
 
-    server.AddTranscoder(&record);
+    for (auto &codec : codecs)
+    {
+        server.AddTranscoder(codec.get());
+    }
+
+    std::atomic_bool stopping(false);
+    std::thread clip_thread([&codecs, &stopping, &clip_signals]() {
+        int signal = 0;
+        while (sigwait(&clip_signals, &signal) == 0 && !stopping.load())
+        {
+            for (auto &codec : codecs)
+            {
+                codec->ExportClip();
+            }
+        }
+    });
 
     server.Run();
 
+    stopping.store(true);
+    pthread_kill(clip_thread.native_handle(), SIGUSR1);
+    clip_thread.join();
+
     return 0;
 }
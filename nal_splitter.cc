@@ -0,0 +1,189 @@
+#include "nal_splitter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NAL_SPLITTER_X86 1
+#endif
+
+namespace
+{
+
+const uint8_t *FindStartCodeC(const uint8_t *p, const uint8_t *end)
+{
+    for (; p + 3 <= end; ++p)
+    {
+        // the third byte rules out most positions, check it first
+        if (p[2] > 1)
+        {
+            p += 2;
+        }
+        else if (p[2] == 1 && p[1] == 0 && p[0] == 0)
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef NAL_SPLITTER_X86
+
+// Compares three shifted loads against 00 00 01, so every lane is a complete
+// start code test; lanes are consumed 16 at a time.
+__attribute__((target("sse2"))) const uint8_t *FindStartCodeSSE2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for (; p + 16 + 2 <= end; p += 16)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2));
+        int ones = _mm_movemask_epi8(_mm_cmpeq_epi8(c, one));
+        if (!ones)
+        {
+            continue;
+        }
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        int zeros = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)));
+        int hits = ones & zeros;
+        if (hits)
+        {
+            return p + __builtin_ctz(static_cast<unsigned>(hits));
+        }
+    }
+    return FindStartCodeC(p, end);
+}
+
+__attribute__((target("avx2"))) const uint8_t *FindStartCodeAVX2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    for (; p + 32 + 2 <= end; p += 32)
+    {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2));
+        unsigned ones = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, one)));
+        if (!ones)
+        {
+            continue;
+        }
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned zeros = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero))));
+        unsigned hits = ones & zeros;
+        if (hits)
+        {
+            return p + __builtin_ctz(hits);
+        }
+    }
+    return FindStartCodeSSE2(p, end);
+}
+
+#endif  // NAL_SPLITTER_X86
+
+using FindStartCodeFn = const uint8_t *(*)(const uint8_t *, const uint8_t *);
+
+FindStartCodeFn SelectFindStartCode()
+{
+#ifdef NAL_SPLITTER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &FindStartCodeAVX2;
+    }
+    return &FindStartCodeSSE2;
+#else
+    return &FindStartCodeC;
+#endif
+}
+
+const FindStartCodeFn find_start_code = SelectFindStartCode();
+
+}  // namespace
+
+const uint8_t *FindStartCode(const uint8_t *begin, const uint8_t *end)
+{
+    return find_start_code(begin, end);
+}
+
+size_t SplitAnnexB(const uint8_t *data, size_t size, std::vector<NalRange> &out)
+{
+    const uint8_t *end = data + size;
+    const uint8_t *p = FindStartCode(data, end);
+    size_t found = 0;
+    while (p < end)
+    {
+        const uint8_t *nal = p + 3;
+        const uint8_t *next = FindStartCode(nal, end);
+        // drops the leading zero of a following 4 byte start code as well
+        const uint8_t *nal_end = next;
+        while (nal_end > nal && nal_end[-1] == 0)
+        {
+            --nal_end;
+        }
+        if (nal_end > nal)
+        {
+            out.push_back(NalRange {static_cast<size_t>(nal - data), static_cast<size_t>(nal_end - nal)});
+            ++found;
+        }
+        p = next;
+    }
+    return found;
+}
+
+NalKind KindOfNal(VideoCodec codec, const uint8_t *nal)
+{
+    if (codec == VideoCodec::H265)
+    {
+        uint8_t type = H265NalTypeOf(nal);
+        if (type >= H265_NAL_BLA_W_LP && type <= H265_NAL_CRA)
+            return NalKind::KeySlice;
+        if (type <= 9)
+            return NalKind::Slice;
+        if (type == H265_NAL_PREFIX_SEI || type == H265_NAL_SUFFIX_SEI)
+            return NalKind::Sei;
+        if (type == H265_NAL_VPS)
+            return NalKind::Vps;
+        if (type == H265_NAL_SPS)
+            return NalKind::Sps;
+        if (type == H265_NAL_PPS)
+            return NalKind::Pps;
+        return NalKind::Other;
+    }
+    switch (H264NalTypeOf(nal))
+    {
+        case H264_NAL_SLICE:
+            return NalKind::Slice;
+        case H264_NAL_IDR_SLICE:
+            return NalKind::KeySlice;
+        case H264_NAL_SEI:
+            return NalKind::Sei;
+        case H264_NAL_SPS:
+            return NalKind::Sps;
+        case H264_NAL_PPS:
+            return NalKind::Pps;
+        default:
+            return NalKind::Other;
+    }
+}
+
+bool ExtractParameterSets(VideoCodec codec, const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    static const uint8_t start_code[] = {0, 0, 0, 1};
+    std::vector<NalRange> ranges;
+    SplitAnnexB(data, size, ranges);
+    std::vector<uint8_t> found;
+    for (const auto &range : ranges)
+    {
+        auto kind = KindOfNal(codec, data + range.offset);
+        if (kind == NalKind::Vps || kind == NalKind::Sps || kind == NalKind::Pps)
+        {
+            found.insert(found.end(), start_code, start_code + sizeof(start_code));
+            found.insert(found.end(), data + range.offset, data + range.offset + range.size);
+        }
+    }
+    if (found.empty())
+    {
+        return false;
+    }
+    out.swap(found);
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef __NAL_SPLITTER_HPP__
+#define __NAL_SPLITTER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One NAL unit inside an Annex B buffer, start code excluded.
+struct NalRange
+{
+    size_t offset;
+    size_t size;
+};
+
+enum H264NalType : uint8_t
+{
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR_SLICE = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+};
+
+inline uint8_t H264NalTypeOf(const uint8_t *nal)
+{
+    return nal[0] & 0x1f;
+}
+
+enum H265NalType : uint8_t
+{
+    // 16..21 are the random access (IRAP) pictures
+    H265_NAL_BLA_W_LP = 16,
+    H265_NAL_IDR_W_RADL = 19,
+    H265_NAL_IDR_N_LP = 20,
+    H265_NAL_CRA = 21,
+    H265_NAL_VPS = 32,
+    H265_NAL_SPS = 33,
+    H265_NAL_PPS = 34,
+    H265_NAL_AUD = 35,
+    H265_NAL_PREFIX_SEI = 39,
+    H265_NAL_SUFFIX_SEI = 40,
+};
+
+// H.265 NAL headers are two bytes, the type sits in the first one
+inline uint8_t H265NalTypeOf(const uint8_t *nal)
+{
+    return (nal[0] >> 1) & 0x3f;
+}
+
+enum class VideoCodec
+{
+    H264,
+    H265,
+};
+
+// What a NAL unit is for, whatever the codec.
+enum class NalKind
+{
+    Slice,
+    KeySlice,  // IDR, or any random access picture in H.265
+    Sei,
+    Vps,       // H.265 only
+    Sps,
+    Pps,
+    Other,
+};
+
+NalKind KindOfNal(VideoCodec codec, const uint8_t *nal);
+
+// First byte of the next 00 00 01 start code in [begin, end), or end.
+const uint8_t *FindStartCode(const uint8_t *begin, const uint8_t *end);
+
+// Appends every NAL unit of an Annex B access unit to `out` (3 and 4 byte
+// start codes, trailing zero bytes trimmed) and returns how many were found.
+size_t SplitAnnexB(const uint8_t *data, size_t size, std::vector<NalRange> &out);
+
+// Replaces `out` with the parameter set NALs (VPS for H.265, SPS, PPS) of an
+// Annex B access unit, each behind a 4 byte start code, as muxers take them
+// for extradata. Leaves `out` alone and returns false if there are none.
+bool ExtractParameterSets(VideoCodec codec, const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+#endif  // __NAL_SPLITTER_HPP__
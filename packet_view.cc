@@ -0,0 +1,107 @@
+#include "packet_view.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+#endif
+
+#include <assert.h>
+#include <string.h>
+#include <utility>
+
+PacketView::PacketView(const AVPacket *packet, size_t offset, size_t size)
+    : data_(packet->data + offset)
+    , size_(size)
+    , pts_(packet->pts)
+    , key_frame_((packet->flags & AV_PKT_FLAG_KEY) != 0)
+{
+    // encoder output is always refcounted, a view must never outlive a borrowed buffer
+    assert(packet->buf);
+    assert(offset + size <= static_cast<size_t>(packet->size));
+    buf_ = av_buffer_ref(packet->buf);
+    assert(buf_);
+}
+
+PacketView::PacketView(const PacketView &other)
+    : buf_(other.buf_ ? av_buffer_ref(other.buf_) : nullptr)
+    , data_(other.data_)
+    , size_(other.size_)
+    , pts_(other.pts_)
+    , time_us_(other.time_us_)
+    , encode_time_us_(other.encode_time_us_)
+    , key_frame_(other.key_frame_)
+{
+}
+
+PacketView::PacketView(PacketView &&other) noexcept
+    : buf_(std::exchange(other.buf_, nullptr))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , pts_(other.pts_)
+    , time_us_(other.time_us_)
+    , encode_time_us_(other.encode_time_us_)
+    , key_frame_(other.key_frame_)
+{
+}
+
+PacketView &PacketView::operator=(const PacketView &other)
+{
+    if (this != &other)
+    {
+        PacketView tmp(other);
+        *this = std::move(tmp);
+    }
+    return *this;
+}
+
+PacketView &PacketView::operator=(PacketView &&other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        buf_ = std::exchange(other.buf_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        pts_ = other.pts_;
+        time_us_ = other.time_us_;
+        encode_time_us_ = other.encode_time_us_;
+        key_frame_ = other.key_frame_;
+    }
+    return *this;
+}
+
+PacketView::~PacketView()
+{
+    Reset();
+}
+
+PacketView PacketView::Copy(const uint8_t *data, size_t size, int64_t pts, bool key_frame)
+{
+    PacketView view;
+    view.buf_ = av_buffer_alloc(static_cast<int>(size));
+    assert(view.buf_);
+    memcpy(view.buf_->data, data, size);
+    view.data_ = view.buf_->data;
+    view.size_ = size;
+    view.pts_ = pts;
+    view.key_frame_ = key_frame;
+    return view;
+}
+
+PacketView PacketView::Slice(size_t offset, size_t size) const
+{
+    assert(offset + size <= size_);
+    PacketView view(*this);
+    view.data_ += offset;
+    view.size_ = size;
+    return view;
+}
+
+void PacketView::Reset()
+{
+    av_buffer_unref(&buf_);
+    data_ = nullptr;
+    size_ = 0;
+}
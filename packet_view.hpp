@@ -0,0 +1,51 @@
+#ifndef __PACKET_VIEW_HPP__
+#define __PACKET_VIEW_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+struct AVBufferRef;
+struct AVPacket;
+
+// Read-only window into the refcounted buffer of an encoded AVPacket.
+// Copying a view only bumps the buffer refcount, the payload is never copied.
+class PacketView
+{
+public:
+    PacketView() = default;
+    PacketView(const AVPacket *packet, size_t offset, size_t size);
+    PacketView(const PacketView &);
+    PacketView(PacketView &&) noexcept;
+    PacketView &operator=(const PacketView &);
+    PacketView &operator=(PacketView &&) noexcept;
+    ~PacketView();
+
+    // view of a new buffer holding a copy of `data`, for small generated NALs such as SEI
+    static PacketView Copy(const uint8_t *data, size_t size, int64_t pts, bool key_frame);
+
+    PacketView Slice(size_t offset, size_t size) const;
+    void Reset();
+
+    const uint8_t *Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+    int64_t Pts() const { return pts_; }
+    bool KeyFrame() const { return key_frame_; }
+    // wallclock presentation time in microseconds, shared by all NALs of an access unit
+    int64_t Time() const { return time_us_; }
+    void SetTime(int64_t time_us) { time_us_ = time_us; }
+    // wallclock microseconds when the encoder returned the access unit
+    int64_t EncodeTime() const { return encode_time_us_; }
+    void SetEncodeTime(int64_t time_us) { encode_time_us_ = time_us; }
+
+private:
+    AVBufferRef *buf_ = nullptr;
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    int64_t pts_ = 0;
+    int64_t time_us_ = 0;
+    int64_t encode_time_us_ = 0;
+    bool key_frame_ = false;
+};
+
+#endif  // __PACKET_VIEW_HPP__
@@ -0,0 +1,332 @@
+// Benchmark: the full RecordCodec pipeline (read, decode, rate conversion,
+// color conversion, scale, encode, NAL split) without a display or RTSP
+// clients. Frames come from a deterministic lavfi testsrc2, or from a raw
+// video file, and the encoded NALs are counted where live555 would receive them.
+//
+//   ./bench [-f frames] [-i bgr0|yuv420p|file.raw:WxH:pix_fmt] [-o results.jsonl] [-p native,filter]
+//
+// Every case (resolution x stream count x pacing) appends one JSON object per
+// line to the results file, so runs can be diffed and tracked for regressions.
+// Pacing "native" captures at the output rate, "filter" captures 5/3 as many
+// frames and drops them to the output rate in an fps filter graph (25 -> 15
+// fps); the CPU one saves over the other is printed per stream.
+
+#include "codec.hpp"
+#include "config.hpp"
+#include "worker_pool.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/log.h>
+#include <libavutil/time.h>
+}
+#endif
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Allocation counting by interposing the allocator of the whole process,
+// FFmpeg's av_malloc goes through posix_memalign.
+static std::atomic<uint64_t> allocations(0);
+
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+
+void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+}
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Case
+{
+    int width;
+    int height;
+    int streams;
+};
+
+struct Options
+{
+    int frames = 300;
+    // frames are produced as fast as the pipeline takes them, this only sets the timestamps
+    int fps = 1000;
+    std::string input = "bgr0";
+    std::string output = "bench_results.jsonl";
+    std::vector<std::string> pacings = {"native", "filter"};
+    std::vector<Case> cases = {
+        {640, 360, 1}, {1280, 720, 1}, {1920, 1080, 1},
+        {1280, 720, 2}, {1280, 720, 4}, {1920, 1080, 4},
+    };
+};
+
+double CpuSeconds()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+StreamConfig MakeStream(const Options &opt, const Case &c, const std::string &pacing, int index)
+{
+    StreamConfig s;
+    s.name = "bench" + std::to_string(index);
+    s.fps = opt.fps;
+    s.capture_fps = opt.fps;
+    if (pacing == "filter")
+    {
+        // the former x11grab at 25 fps into fps=15, through a graph that filters nothing else
+        s.capture_fps = opt.fps * 5 / 3;
+        s.filter = "null";
+    }
+    auto colon = opt.input.find(':');
+    if (colon == std::string::npos)
+    {
+        // a 1080p "screen" scaled down to the case resolution; testsrc2 stops
+        // after `frames` frames, which ends the capture
+        s.input_format = "lavfi";
+        s.input = "testsrc2=size=1920x1080:rate=" + std::to_string(s.capture_fps) +
+                  ":duration=" + std::to_string(static_cast<double>(opt.frames) / opt.fps) + ",format=" + opt.input;
+    }
+    else
+    {
+        // file.raw:WxH:pix_fmt, also scaled to the case resolution
+        s.input_format = "rawvideo";
+        s.input = opt.input.substr(0, colon);
+        auto rest = opt.input.substr(colon + 1);
+        auto second = rest.find(':');
+        auto size = rest.substr(0, second);
+        s.capture_width = std::atoi(size.c_str());
+        s.capture_height = std::atoi(size.substr(size.find('x') + 1).c_str());
+        s.capture_pix_fmt = second == std::string::npos ? "yuv420p" : rest.substr(second + 1);
+    }
+    s.width = c.width;
+    s.height = c.height;
+    // every frame is encoded, a slow stage throttles capture instead of dropping
+    s.queue_overflow = "block";
+    s.adaptive_bitrate = false;
+    return s;
+}
+
+std::string Json(const Options &opt, const Case &c, const std::string &pacing, uint64_t frames, double seconds, double cpu, uint64_t allocs, std::vector<std::unique_ptr<RecordCodec>> &codecs)
+{
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+             "{\"bench\":\"pipeline\",\"input\":\"%s\",\"pacing\":\"%s\",\"width\":%d,\"height\":%d,\"streams\":%d,\"frames\":%llu,"
+             "\"fps\":%.1f,\"cpu_ms_per_frame\":%.3f,\"allocs_per_frame\":%.1f,\"stages\":{",
+             opt.input.c_str(), pacing.c_str(), c.width, c.height, c.streams, static_cast<unsigned long long>(frames),
+             static_cast<double>(frames) / seconds, frames ? cpu * 1000 / static_cast<double>(frames) : 0.0,
+             frames ? static_cast<double>(allocs) / static_cast<double>(frames) : 0.0);
+    std::string out = buf;
+    for (int stage = 0; stage < StageLatency::STAGES; ++stage)
+    {
+        // worst stream per stage
+        int64_t p50 = 0;
+        int64_t p99 = 0;
+        for (auto &codec : codecs)
+        {
+            for (const auto &r : codec->Renditions())
+            {
+                p50 = std::max(p50, r->Latency().stages[stage].Percentile(0.50));
+                p99 = std::max(p99, r->Latency().stages[stage].Percentile(0.99));
+            }
+        }
+        snprintf(buf, sizeof(buf), "%s\"%s\":{\"p50_ms\":%.3f,\"p99_ms\":%.3f}", stage ? "," : "",
+                 StageLatency::Name(static_cast<StageLatency::Stage>(stage)), p50 / 1000.0, p99 / 1000.0);
+        out += buf;
+    }
+    out += "}}";
+    return out;
+}
+
+// `cpu_per_frame` receives the CPU milliseconds per encoded frame of one stream
+std::string RunCase(const Options &opt, const Case &c, const std::string &pacing, double &cpu_per_frame)
+{
+    ooknn::WorkerPool pool;
+    std::vector<std::unique_ptr<RecordCodec>> codecs;
+    for (int i = 0; i < c.streams; ++i)
+    {
+        codecs.push_back(std::make_unique<RecordCodec>(MakeStream(opt, c, pacing, i), pool));
+    }
+
+    // NAL delivery is timed where the framed source would take over
+    std::atomic<uint64_t> frames(0);
+    for (auto &codec : codecs)
+    {
+        for (const auto &r : codec->Renditions())
+        {
+            Rendition *rendition = r.get();
+            auto last_pts = std::make_shared<int64_t>(INT64_MIN);
+            rendition->SetOnEncodedDataCallback([rendition, last_pts, &frames](PacketView &&nal) {
+                if (nal.Pts() == *last_pts)
+                {
+                    return;
+                }
+                *last_pts = nal.Pts();
+                int64_t now = av_gettime();
+                rendition->Latency().Record(StageLatency::Deliver, now - nal.EncodeTime());
+                rendition->Latency().Record(StageLatency::Total, now - nal.Time());
+                frames.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+    }
+
+    uint64_t expected = static_cast<uint64_t>(opt.frames) * static_cast<uint64_t>(c.streams);
+    uint64_t allocs_before = allocations.load();
+    double cpu_before = CpuSeconds();
+    auto begin = Clock::now();
+    for (auto &codec : codecs)
+    {
+        codec->Start();
+    }
+
+    // done once every frame came out, or when nothing moved for two seconds
+    uint64_t seen = 0;
+    auto last_progress = Clock::now();
+    while (seen < expected && Clock::now() - last_progress < std::chrono::seconds(2))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (frames.load() != seen)
+        {
+            seen = frames.load();
+            last_progress = Clock::now();
+        }
+    }
+    double seconds = std::chrono::duration<double>((seen < expected ? last_progress : Clock::now()) - begin).count();
+    double cpu = CpuSeconds() - cpu_before;
+    uint64_t allocs = allocations.load() - allocs_before;
+
+    cpu_per_frame = seen ? cpu * 1000 / static_cast<double>(seen) : 0.0;
+    std::string json = Json(opt, c, pacing, seen, seconds, cpu, allocs, codecs);
+    for (auto &codec : codecs)
+    {
+        // the busiest stage is the one to scale out with stage_cpus
+        fprintf(stderr, "%s: %s\n", codec->Name().c_str(), codec->StageSummary().c_str());
+        codec->Stop();
+    }
+    return json;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    int o = 0;
+    while ((o = getopt(argc, argv, "f:i:o:p:")) != -1)
+    {
+        switch (o)
+        {
+            case 'f':
+                opt.frames = std::max(1, std::atoi(optarg));
+                break;
+            case 'i':
+                opt.input = optarg;
+                break;
+            case 'o':
+                opt.output = optarg;
+                break;
+            case 'p':
+            {
+                opt.pacings.clear();
+                std::istringstream list(optarg);
+                std::string pacing;
+                while (std::getline(list, pacing, ','))
+                {
+                    opt.pacings.push_back(pacing);
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "usage: %s [-f frames] [-i bgr0|yuv420p|file.raw:WxH:pix_fmt] [-o results.jsonl] [-p native,filter]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *out = fopen(opt.output.c_str(), "a");
+    if (!out)
+    {
+        fprintf(stderr, "cannot open %s\n", opt.output.c_str());
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_QUIET);
+    for (const auto &c : opt.cases)
+    {
+        std::map<std::string, double> cpu_per_frame;
+        for (const auto &pacing : opt.pacings)
+        {
+            // the pipeline logs on std::cout, keep the report readable
+            std::cout.setstate(std::ios::badbit);
+            std::string json = RunCase(opt, c, pacing, cpu_per_frame[pacing]);
+            std::cout.clear();
+
+            fprintf(out, "%s\n", json.c_str());
+            fflush(out);
+            fprintf(stderr, "%s\n", json.c_str());
+        }
+        if (cpu_per_frame.count("native") && cpu_per_frame.count("filter"))
+        {
+            // per encoded frame of each stream, and per second of a 15 fps stream
+            double saved = cpu_per_frame["filter"] - cpu_per_frame["native"];
+            fprintf(stderr, "%dx%d x%d: native pacing saves %.3f ms CPU per frame per stream (%.0f%%), %.1f ms per second at 15 fps\n",
+                    c.width, c.height, c.streams, saved, cpu_per_frame["filter"] > 0 ? 100 * saved / cpu_per_frame["filter"] : 0.0, saved * 15);
+        }
+    }
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Microbenchmark: ooknn::SpscRing against ooknn::ThreadQueue for the
+// capture -> encode handoff. Each element carries its push timestamp so the
+// consumer can measure per-item handoff latency.
+//
+//   ./queue_bench [items] [capacity]
+
+#include "spsc_ring.hpp"
+#include "thread_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t NowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+struct Result
+{
+    std::string name;
+    double seconds = 0;
+    size_t received = 0;
+    uint64_t dropped = 0;
+    std::vector<uint64_t> latency;
+};
+
+void Report(Result &r, size_t items)
+{
+    std::sort(r.latency.begin(), r.latency.end());
+    auto pct = [&r](double p) -> uint64_t {
+        if (r.latency.empty())
+        {
+            return 0;
+        }
+        return r.latency[std::min(r.latency.size() - 1, static_cast<size_t>(p * static_cast<double>(r.latency.size())))];
+    };
+    printf("%-26s %10.2f Mops/s  recv %8zu/%zu  dropped %8llu  p50 %7llu ns  p99 %8llu ns  max %9llu ns\n",
+           r.name.c_str(),
+           static_cast<double>(r.received) / r.seconds / 1e6,
+           r.received,
+           items,
+           static_cast<unsigned long long>(r.dropped),
+           static_cast<unsigned long long>(pct(0.50)),
+           static_cast<unsigned long long>(pct(0.99)),
+           static_cast<unsigned long long>(r.latency.empty() ? 0 : r.latency.back()));
+}
+
+// 0 is the end-of-stream marker, timestamps are never 0
+Result RunThreadQueue(size_t items)
+{
+    Result r;
+    r.name = "ThreadQueue";
+    r.latency.reserve(items);
+    ooknn::ThreadQueue<uint64_t> q;
+
+    auto begin = Clock::now();
+    std::thread consumer([&]() {
+        while (true)
+        {
+            uint64_t v = q.Pop();
+            if (v == 0)
+            {
+                break;
+            }
+            r.latency.push_back(NowNs() - v);
+            ++r.received;
+        }
+    });
+    for (size_t i = 0; i < items; ++i)
+    {
+        q.Push(NowNs());
+    }
+    q.Push(0);
+    consumer.join();
+    r.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    return r;
+}
+
+Result RunRing(size_t items, size_t capacity, ooknn::OverflowPolicy overflow, ooknn::WaitPolicy wait, const char *name)
+{
+    Result r;
+    r.name = name;
+    r.latency.reserve(items);
+    ooknn::SpscRing<uint64_t> q(capacity, overflow, wait);
+
+    auto begin = Clock::now();
+    std::thread consumer([&]() {
+        while (true)
+        {
+            uint64_t v = q.Pop();
+            if (v == 0)
+            {
+                break;
+            }
+            r.latency.push_back(NowNs() - v);
+            ++r.received;
+        }
+    });
+    for (size_t i = 0; i < items; ++i)
+    {
+        q.Push(NowNs());
+    }
+    q.Close();
+    consumer.join();
+    r.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    r.dropped = q.Dropped();
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    size_t items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    size_t capacity = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+    printf("items %zu, ring capacity %zu, hardware threads %u\n", items, capacity, std::thread::hardware_concurrency());
+
+    std::vector<Result> results;
+    results.push_back(RunThreadQueue(items));
+    results.push_back(RunRing(items, capacity, ooknn::OverflowPolicy::Block, ooknn::WaitPolicy::Block, "SpscRing block/block"));
+    results.push_back(RunRing(items, capacity, ooknn::OverflowPolicy::Block, ooknn::WaitPolicy::Spin, "SpscRing block/spin"));
+    results.push_back(RunRing(items, capacity, ooknn::OverflowPolicy::DropOldest, ooknn::WaitPolicy::Block, "SpscRing drop-oldest/block"));
+    results.push_back(RunRing(items, capacity, ooknn::OverflowPolicy::DropNewest, ooknn::WaitPolicy::Block, "SpscRing drop-newest/block"));
+
+    for (auto &r : results)
+    {
+        Report(r, items);
+    }
+    return 0;
+}
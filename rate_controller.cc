@@ -0,0 +1,153 @@
+#include "rate_controller.hpp"
+#include "encoder_profile.hpp"
+#include "rendition.hpp"
+
+#include <liveMedia.hh>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+// receiver reports count loss in 1/256 and jitter in RTP timestamp units (90 kHz video clock)
+#define RTP_VIDEO_CLOCK_KHZ 90.0
+// RTT in receiver reports is in 1/65536 s
+#define RTCP_RTT_UNITS_PER_MS 65.536
+
+// above this loss the rate is cut by half the loss fraction
+#define LOSS_DECREASE 0.10
+// below this loss, without queueing delay, the rate may grow
+#define LOSS_INCREASE 0.02
+#define INCREASE_FACTOR 1.08
+#define JITTER_CONGESTED_MS 50.0
+#define DECREASE_INTERVAL std::chrono::milliseconds(500)
+#define INCREASE_INTERVAL std::chrono::seconds(1)
+
+RateController::RateController(Rendition *rendition)
+    : rendition_(rendition)
+    , enabled_(rendition->Stream().adaptive_bitrate)
+    , max_bit_rate_(rendition->Config().bit_rate)
+    , min_bit_rate_(std::min(rendition->Stream().min_bit_rate, rendition->Config().bit_rate))
+    , percentile_(rendition->Stream().abr_percentile)
+    , target_(rendition->Config().bit_rate)
+    , base_rtt_ms_(0)
+    , last_change_(Clock::now())
+{
+    if (!enabled_)
+    {
+        return;
+    }
+    // Rendition::ApplyBitRate reaches the encoder only through libx264's
+    // reconfiguration, and a constant quality profile has no rate to steer
+    const EncoderProfile *profile = FindEncoderProfile(rendition->Stream().encoder_profile);
+    std::string encoder = EncoderOf(rendition->Stream());
+    if (encoder != "libx264")
+    {
+        std::cout << rendition->Name() << ": adaptive bitrate off, " << encoder << " keeps its opening rate" << std::endl;
+        enabled_ = false;
+    }
+    else if (profile && profile->rate_control == EncoderProfile::RateControl::Crf)
+    {
+        std::cout << rendition->Name() << ": adaptive bitrate off, profile " << profile->name << " is constant quality" << std::endl;
+        enabled_ = false;
+    }
+}
+
+void RateController::AddSink(RTPSink *sink)
+{
+    sinks_.push_back(sink);
+}
+
+void RateController::RemoveSink(RTPSink *sink)
+{
+    sinks_.erase(std::remove(sinks_.begin(), sinks_.end(), sink), sinks_.end());
+    if (sinks_.empty() && target_ != max_bit_rate_)
+    {
+        // the next viewer starts from full quality again
+        target_ = max_bit_rate_;
+        base_rtt_ms_ = 0;
+        rendition_->SetBitRate(target_);
+    }
+}
+
+void RateController::OnReceiverReport0(void *clientData)
+{
+    static_cast<RateController *>(clientData)->OnReceiverReport();
+}
+
+void RateController::Collect(std::vector<ClientReport> &reports) const
+{
+    reports.clear();
+    for (auto sink : sinks_)
+    {
+        RTPTransmissionStatsDB::Iterator it(sink->transmissionStatsDB());
+        while (RTPTransmissionStats *stats = it.next())
+        {
+            reports.push_back(ClientReport {stats->packetLossRatio() / 256.0,
+                                            stats->jitter() / RTP_VIDEO_CLOCK_KHZ,
+                                            stats->roundTripDelay() / RTCP_RTT_UNITS_PER_MS});
+        }
+    }
+}
+
+void RateController::OnReceiverReport()
+{
+    if (!enabled_)
+    {
+        return;
+    }
+    Collect(reports_);
+    if (reports_.empty())
+    {
+        return;
+    }
+
+    for (const auto &r : reports_)
+    {
+        if (r.rtt_ms > 0 && (base_rtt_ms_ == 0 || r.rtt_ms < base_rtt_ms_))
+        {
+            base_rtt_ms_ = r.rtt_ms;
+        }
+    }
+
+    // rank clients from worst to best and follow the one at the percentile
+    auto badness = [this](const ClientReport &r) {
+        return r.loss * 1000.0 + std::max(0.0, r.rtt_ms - base_rtt_ms_) + r.jitter_ms;
+    };
+    std::sort(reports_.begin(), reports_.end(), [&badness](const ClientReport &a, const ClientReport &b) { return badness(a) > badness(b); });
+    size_t index = std::min(reports_.size() - 1, reports_.size() * static_cast<size_t>(100 - percentile_) / 100);
+    const ClientReport &r = reports_[index];
+
+    auto now = Clock::now();
+    bool queueing = r.jitter_ms > JITTER_CONGESTED_MS || (base_rtt_ms_ > 0 && r.rtt_ms > 2 * base_rtt_ms_ && r.rtt_ms > base_rtt_ms_ + 100);
+    int64_t target = target_;
+    if (r.loss > LOSS_DECREASE || queueing)
+    {
+        if (now - last_change_ < DECREASE_INTERVAL)
+        {
+            return;
+        }
+        target = static_cast<int64_t>(static_cast<double>(target_) * (1.0 - std::max(r.loss, LOSS_DECREASE) / 2));
+    }
+    else if (r.loss < LOSS_INCREASE)
+    {
+        if (now - last_change_ < INCREASE_INTERVAL)
+        {
+            return;
+        }
+        target = static_cast<int64_t>(static_cast<double>(target_) * INCREASE_FACTOR);
+    }
+    Update(std::max(min_bit_rate_, std::min(max_bit_rate_, target)), r, reports_.size());
+}
+
+void RateController::Update(int64_t target, const ClientReport &report, size_t clients)
+{
+    if (target == target_)
+    {
+        return;
+    }
+    std::cout << rendition_->Name() << ": bitrate " << target_ / 1000 << " -> " << target / 1000 << " kbps (loss "
+              << report.loss * 100 << "%, jitter " << report.jitter_ms << " ms, rtt " << report.rtt_ms << " ms, "
+              << clients << " clients)" << std::endl;
+    target_ = target;
+    last_change_ = Clock::now();
+    rendition_->SetBitRate(target_);
+}
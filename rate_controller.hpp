@@ -0,0 +1,52 @@
+#ifndef __RATE_CONTROLLER_HPP__
+#define __RATE_CONTROLLER_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class Rendition;
+class RTPSink;
+
+// Steers the bitrate of one rendition from the RTCP receiver reports of all
+// of its clients. Lives on the live555 event loop thread: sinks are added from
+// createRTCP, removed from deleteStream and every receiver report triggers an
+// update. Loss or growing delay at the chosen percentile client cuts the rate
+// multiplicatively, a clean network raises it slowly back to the configured one.
+class RateController
+{
+public:
+    explicit RateController(Rendition *rendition);
+
+    void AddSink(RTPSink *sink);
+    void RemoveSink(RTPSink *sink);
+    // RTCPInstance::setRRHandler callback, clientData is the controller
+    static void OnReceiverReport0(void *clientData);
+    void OnReceiverReport();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct ClientReport
+    {
+        double loss;  // fraction lost since the previous report, 0..1
+        double jitter_ms;
+        double rtt_ms;
+    };
+
+    void Collect(std::vector<ClientReport> &reports) const;
+    void Update(int64_t target, const ClientReport &report, size_t clients);
+
+    Rendition *rendition_;
+    bool enabled_;
+    int64_t max_bit_rate_;
+    int64_t min_bit_rate_;
+    int percentile_;
+    int64_t target_;
+    // lowest RTT seen, the uncongested baseline
+    double base_rtt_ms_;
+    Clock::time_point last_change_;
+    std::vector<RTPSink *> sinks_;
+    std::vector<ClientReport> reports_;
+};
+
+#endif  // __RATE_CONTROLLER_HPP__
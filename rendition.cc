@@ -0,0 +1,442 @@
+#include "rendition.hpp"
+#include "encoder_profile.hpp"
+#include "scoped_exit.hpp"
+#include "timestamp_sei.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+#endif
+
+#include <iostream>
+#include <assert.h>
+#include <chrono>
+
+static ooknn::OverflowPolicy OverflowPolicyFromName(const std::string &name)
+{
+    if (name == "drop-newest")
+        return ooknn::OverflowPolicy::DropNewest;
+    if (name == "block")
+        return ooknn::OverflowPolicy::Block;
+    return ooknn::OverflowPolicy::DropOldest;
+}
+
+Rendition::Rendition(const StreamConfig &stream,
+                     const RenditionConfig &config,
+                     int src_width,
+                     int src_height,
+                     AVPixelFormat src_format,
+                     ooknn::WorkerPool &pool)
+    : stream_(stream)
+    , config_(config)
+    , name_(SessionName(stream, config))
+    , encoder_(EncoderOf(stream))
+    , codec_id_(stream.codec == "hevc" ? VideoCodec::H265 : VideoCodec::H264)
+    , encoder_pix_fmt_(av_get_pix_fmt(stream.pix_fmt.c_str()))
+    , format_ctx_(nullptr)
+    , codec_ctx_(nullptr)
+    , codec_(nullptr)
+    , video_stream_(nullptr)
+    , encoding_packet_(nullptr)
+    , stop_flag_(false)
+    , key_frame_requested_(false)
+    , target_bit_rate_(config.bit_rate)
+    , max_rate_ratio_(0)
+    , buffer_ratio_(0)
+    , deque_(stream.queue_capacity, OverflowPolicyFromName(stream.queue_overflow), ooknn::WaitPolicy::Block)
+    , encode_period_(std::chrono::microseconds(1000000 / stream.fps))
+    , encode_clock_(config.name.empty() ? "encode" : "encode/" + config.name)
+    , encode_strand_(pool)
+{
+    assert(encoder_pix_fmt_ != AV_PIX_FMT_NONE);
+
+    InitializeEncoder();
+
+    // one frame being scaled and one being encoded
+    scaler_ = std::make_unique<FrameConverter>(src_width, src_height, src_format, config_.width, config_.height, encoder_pix_fmt_, 2, ScaleFlagsFromName(stream_.scale_filter));
+    std::cout << name_ << ": " << config_.width << "x" << config_.height << " @ " << config_.bit_rate << " bps, " << scaler_->Description() << std::endl;
+}
+
+Rendition::~Rendition()
+{
+    Stop();
+}
+
+void Rendition::InitializeEncoder()
+{
+
+    std::cout << "Initialize " << encoder_ << " encoder for " << name_ << std::endl;
+
+    int statCode = avformat_alloc_output_context2(&format_ctx_, nullptr, "null", nullptr);
+    assert(statCode >= 0);
+
+    codec_ = avcodec_find_encoder_by_name(encoder_.c_str());
+    // Validate has checked that it exists and encodes the stream's codec
+    assert(codec_);
+
+    video_stream_ = avformat_new_stream(format_ctx_, codec_);
+    assert(video_stream_);
+    video_stream_->id = format_ctx_->nb_streams - 1;
+
+    codec_ctx_ = avcodec_alloc_context3(codec_);
+    assert(codec_ctx_);
+
+    codec_ctx_->width = config_.width;
+    codec_ctx_->height = config_.height;
+
+    // frames leave rate conversion with pts in 1/fps units
+    codec_ctx_->time_base = (AVRational) {1, stream_.fps};
+    codec_ctx_->framerate = (AVRational) {stream_.fps, 1};
+    codec_ctx_->bit_rate = config_.bit_rate;
+    codec_ctx_->gop_size = stream_.gop;
+    codec_ctx_->thread_count = stream_.encoder_threads;
+
+    codec_ctx_->pix_fmt = encoder_pix_fmt_;
+    if (format_ctx_->oformat->flags & AVFMT_GLOBALHEADER)
+    {
+        codec_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    const EncoderProfile *profile = FindEncoderProfile(stream_.encoder_profile);
+    assert(profile);
+    AVDictionary *options = nullptr;
+    ApplyEncoderProfile(*profile, config_.bit_rate, stream_.fps, codec_ctx_, &options);
+    std::cout << name_ << ": encoder profile " << DescribeEncoderProfile(*profile) << std::endl;
+
+    avcodec_parameters_from_context(video_stream_->codecpar, codec_ctx_);
+    statCode = avcodec_open2(codec_ctx_, codec_, &options);
+    // whatever is left was not understood by this encoder
+    AVDictionaryEntry *unused = nullptr;
+    while ((unused = av_dict_get(options, "", unused, AV_DICT_IGNORE_SUFFIX)))
+    {
+        std::cout << name_ << ": " << encoder_ << " ignored option " << unused->key << "=" << unused->value << std::endl;
+    }
+    av_dict_free(&options);
+    assert(statCode == 0);
+    if (codec_ctx_->bit_rate > 0)
+    {
+        max_rate_ratio_ = static_cast<double>(codec_ctx_->rc_max_rate) / static_cast<double>(codec_ctx_->bit_rate);
+        buffer_ratio_ = static_cast<double>(codec_ctx_->rc_buffer_size) / static_cast<double>(codec_ctx_->bit_rate);
+    }
+    statCode = avformat_write_header(format_ctx_, nullptr);
+    assert(statCode >= 0);
+
+    av_dump_format(format_ctx_, video_stream_->index, "null", 1);
+
+    encoding_packet_ = av_packet_alloc();
+    av_init_packet(encoding_packet_);
+}
+
+void Rendition::Offer(const AVFrame *frame)
+{
+    if (stop_flag_.load())
+    {
+        return;
+    }
+    // a reference only, the picture is shared by all renditions
+    AVFrame *ref = av_frame_clone(frame);
+    assert(ref);
+    backlog_.push_back(ref);
+    Flush();
+}
+
+bool Rendition::Flush()
+{
+    size_t queued = 0;
+    for (; queued < backlog_.size(); ++queued)
+    {
+        AVFrame *frame = backlog_[queued];
+        if (deque_.Overflow() == ooknn::OverflowPolicy::Block)
+        {
+            // never wait inside a pool task, the encoder may need this very worker
+            if (!deque_.TryPush(frame))
+            {
+                break;
+            }
+        }
+        // a full ring evicts the stalest frame instead of throttling capture
+        else if (auto dropped = deque_.Push(frame))
+        {
+            av_frame_free(&*dropped);
+        }
+        encode_strand_.Post([this]() { EncodeStep(); }, ooknn::Clock::now() + encode_period_);
+    }
+    backlog_.erase(backlog_.begin(), backlog_.begin() + queued);
+    return backlog_.empty();
+}
+
+void Rendition::EncodeStep()
+{
+    if (stop_flag_.load())
+    {
+        return;
+    }
+    ooknn::StageStep step(encode_clock_);
+    EncodeFrameToSend();
+}
+
+void Rendition::EncodeFrameToSend()
+{
+    auto next = deque_.TryPop();
+    if (!next)
+    {
+        return;
+    }
+    AVFrame *shared = *next;
+    PendingTiming timing {shared->pts, FrameTiming(), av_gettime(), 0};
+    if (!GetFrameTiming(shared, timing.frame))
+    {
+        timing.frame.captured = timing.frame.decoded = timing.frame.filtered = timing.frame.converted = timing.dequeued;
+    }
+    AVFrame *p = scaler_->Convert(shared);
+    av_frame_free(&shared);
+    timing.scaled = av_gettime();
+
+    auto p_clean = make_scoped_exit([&p]() { av_frame_free(&p); });
+    // frames the encoder swallowed without output (errors, flushes) must not pile up
+    if (pending_timing_.size() >= 64)
+    {
+        pending_timing_.pop_front();
+    }
+    pending_timing_.push_back(timing);
+
+    ApplyBitRate();
+
+    // rawvideo marks every picture as I, which libx264 would turn into an IDR per frame
+    p->pict_type = key_frame_requested_.exchange(false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+    if (EncodeFrameToPacket(codec_ctx_, p, encoding_packet_) < 0)
+    {
+        return;
+    }
+    auto pkt_clean = make_scoped_exit([&p = encoding_packet_]() { av_packet_unref(p); });
+
+    int64_t encoded = av_gettime();
+    // with B-frames or lookahead the packet belongs to an older frame
+    while (!pending_timing_.empty() && pending_timing_.front().pts < encoding_packet_->pts)
+    {
+        pending_timing_.pop_front();
+    }
+    int64_t captured = encoded;
+    if (!pending_timing_.empty() && pending_timing_.front().pts == encoding_packet_->pts)
+    {
+        const auto &t = pending_timing_.front();
+        captured = t.frame.captured;
+        latency_.Record(StageLatency::Decode, t.frame.decoded - t.frame.captured);
+        latency_.Record(StageLatency::Filter, t.frame.filtered - t.frame.decoded);
+        latency_.Record(StageLatency::Convert, t.frame.converted - t.frame.filtered);
+        latency_.Record(StageLatency::Queue, t.dequeued - t.frame.converted);
+        latency_.Record(StageLatency::Scale, t.scaled - t.dequeued);
+        latency_.Record(StageLatency::Encode, encoded - t.scaled);
+        pending_timing_.pop_front();
+    }
+
+    for (auto &callback : packet_cbs_)
+    {
+        callback(encoding_packet_, captured);
+    }
+
+    if (!encode_cb_)
+    {
+        return;
+    }
+
+    // one view per NAL into the packet buffer, the discrete framer expects exactly one NAL per frame
+    nal_ranges_.clear();
+    if (!SplitAnnexB(encoding_packet_->data, static_cast<size_t>(encoding_packet_->size), nal_ranges_))
+    {
+        std::cout << name_ << ": encoded packet of " << encoding_packet_->size << " bytes has no start code, dropped" << std::endl;
+        return;
+    }
+
+    // RTP timestamps follow the capture clock, not the queueing in between
+    bool sei_pending = stream_.timestamp_sei;
+    for (const auto &range : nal_ranges_)
+    {
+        PacketView nal(encoding_packet_, range.offset, range.size);
+        nal.SetTime(captured);
+        nal.SetEncodeTime(encoded);
+        auto kind = KindOfNal(codec_id_, nal.Data());
+        if (sei_pending && (kind == NalKind::Slice || kind == NalKind::KeySlice))
+        {
+            // SEI must precede the first slice of the access unit
+            BuildTimestampSei(codec_id_, captured, sei_);
+            PacketView sei = PacketView::Copy(sei_.data(), sei_.size(), nal.Pts(), nal.KeyFrame());
+            sei.SetTime(captured);
+            sei.SetEncodeTime(encoded);
+            encode_cb_(std::move(sei));
+            sei_pending = false;
+        }
+        if (kind == NalKind::Vps || kind == NalKind::Sps || kind == NalKind::Pps)
+        {
+            std::lock_guard<std::mutex> lock(parameter_sets_mutex_);
+            auto &ps = kind == NalKind::Vps ? vps_ : (kind == NalKind::Sps ? sps_ : pps_);
+            ps.assign(nal.Data(), nal.Data() + nal.Size());
+        }
+        encode_cb_(std::move(nal));
+    }
+}
+
+void Rendition::ApplyBitRate()
+{
+    int64_t target = target_bit_rate_.load();
+    // constant quality profiles have no bitrate to steer
+    if (codec_ctx_->bit_rate <= 0 || target == codec_ctx_->bit_rate)
+    {
+        return;
+    }
+    // libx264 compares these with its current parameters on every frame and
+    // calls x264_encoder_reconfig, the encoder is not reopened; libx265 does
+    // not look at them again, so there this only moves the reported target
+    codec_ctx_->bit_rate = target;
+    codec_ctx_->rc_max_rate = static_cast<int64_t>(static_cast<double>(target) * max_rate_ratio_);
+    codec_ctx_->rc_buffer_size = static_cast<int>(static_cast<double>(target) * buffer_ratio_);
+}
+
+int Rendition::EncodeFrameToPacket(AVCodecContext *codecContext, AVFrame *frame, AVPacket *packet)
+{
+
+    int statCode = avcodec_send_frame(codecContext, frame);
+    if (statCode < 0)
+    {
+        return statCode;
+    }
+
+    statCode = avcodec_receive_packet(codecContext, packet);
+
+    if (statCode == AVERROR(EAGAIN) || statCode == AVERROR_EOF)
+    {
+        return statCode;
+    }
+
+    if (statCode < 0)
+    {
+        return statCode;
+    }
+
+    return statCode;
+}
+
+void Rendition::Stop()
+{
+    if (stop_flag_.exchange(true))
+    {
+        return;
+    }
+    // waits for an encode step in progress, afterwards nothing of this rendition runs on the pool
+    encode_strand_.Close();
+    deque_.Close();
+    CleanDeque();
+    CleanUp();
+}
+
+void Rendition::CleanDeque()
+{
+    while (auto p = deque_.TryPop())
+    {
+        av_frame_free(&*p);
+    }
+    for (auto &frame : backlog_)
+    {
+        av_frame_free(&frame);
+    }
+    backlog_.clear();
+}
+
+void Rendition::CleanUp()
+{
+    av_packet_free(&encoding_packet_);
+    avcodec_free_context(&codec_ctx_);
+    avio_close(format_ctx_->pb);
+    avformat_free_context(format_ctx_);
+    format_ctx_ = nullptr;
+
+    if (auto pool = scaler_->Pool())
+    {
+        std::cout << name_ << ": scaler pool of " << pool->Size() << " buffers, hits: " << pool->Hits() << ", misses: " << pool->Misses() << std::endl;
+    }
+    scaler_.reset();
+}
+
+void Rendition::SetOnEncodedDataCallback(CallBackType callback)
+{
+    encode_cb_ = std::move(callback);
+}
+
+void Rendition::AddOnPacketCallback(PacketCallBackType callback)
+{
+    packet_cbs_.push_back(std::move(callback));
+}
+
+void Rendition::CodecParameters(AVCodecParameters *parameters) const
+{
+    avcodec_parameters_from_context(parameters, codec_ctx_);
+}
+
+AVRational Rendition::TimeBase() const
+{
+    return codec_ctx_->time_base;
+}
+
+void Rendition::RequestKeyFrame()
+{
+    key_frame_requested_.store(true);
+}
+
+bool Rendition::KeyFrameRequested() const
+{
+    return key_frame_requested_.load();
+}
+
+void Rendition::SetBitRate(int64_t bit_rate)
+{
+    target_bit_rate_.store(bit_rate);
+}
+
+int64_t Rendition::BitRate() const
+{
+    return target_bit_rate_.load();
+}
+
+VideoCodec Rendition::Codec() const
+{
+    return codec_id_;
+}
+
+bool Rendition::ParameterSets(std::vector<uint8_t> &vps, std::vector<uint8_t> &sps, std::vector<uint8_t> &pps) const
+{
+    std::lock_guard<std::mutex> lock(parameter_sets_mutex_);
+    vps = vps_;
+    sps = sps_;
+    pps = pps_;
+    return !sps.empty() && !pps.empty() && (codec_id_ != VideoCodec::H265 || !vps.empty());
+}
+
+const std::string &Rendition::Name() const
+{
+    return name_;
+}
+
+const RenditionConfig &Rendition::Config() const
+{
+    return config_;
+}
+
+const StreamConfig &Rendition::Stream() const
+{
+    return stream_;
+}
+
+StageLatency &Rendition::Latency()
+{
+    return latency_;
+}
+
+ooknn::StageClock &Rendition::EncodeClock()
+{
+    return encode_clock_;
+}
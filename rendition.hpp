@@ -0,0 +1,147 @@
+#ifndef __RENDITION_HPP__
+#define __RENDITION_HPP__
+
+#include "config.hpp"
+#include "converter.hpp"
+#include "frame_timing.hpp"
+#include "latency_stats.hpp"
+#include "nal_splitter.hpp"
+#include "packet_view.hpp"
+#include "spsc_ring.hpp"
+#include "stage_clock.hpp"
+#include "worker_pool.hpp"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libavutil/rational.h>
+}
+#endif
+
+struct AVCodec;
+struct AVCodecParameters;
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+
+// Scale + encode back end of a RecordCodec. Every rendition gets a reference
+// to the same captured, color converted frame and only pays for its own
+// resize and encode, which run as steps on its strand of the worker pool.
+class Rendition
+{
+public:
+    using CallBackType = std::function<void(PacketView &&)>;
+    // encoded packet and the capture time of its frame (av_gettime)
+    using PacketCallBackType = std::function<void(const AVPacket *, int64_t)>;
+
+    // `src_*` describe the frames passed to Offer
+    Rendition(const StreamConfig &stream,
+              const RenditionConfig &config,
+              int src_width,
+              int src_height,
+              AVPixelFormat src_format,
+              ooknn::WorkerPool &pool);
+    ~Rendition();
+    Rendition(const Rendition &) = delete;
+    Rendition &operator=(const Rendition &) = delete;
+
+    // Queues a reference to `frame` for scaling and encoding. With the Block
+    // overflow policy the frame may wait in a backlog; Flush retries it.
+    void Offer(const AVFrame *frame);
+    // false while frames are still waiting for room in the queue
+    bool Flush();
+    // stops encoding; afterwards the callback is never invoked again
+    void Stop();
+
+    void SetOnEncodedDataCallback(CallBackType callback);
+    // every whole encoded packet, called on the encode strand; add before encoding starts
+    void AddOnPacketCallback(PacketCallBackType callback);
+    // encoder output description for muxers
+    void CodecParameters(AVCodecParameters *parameters) const;
+    AVRational TimeBase() const;
+    // the next encoded frame will be an IDR, safe to call from any thread
+    void RequestKeyFrame();
+    // an IDR was requested and no frame has been encoded since
+    bool KeyFrameRequested() const;
+    // new target bitrate, applied (with a proportional VBV) before the next
+    // frame is encoded; safe to call from any thread
+    void SetBitRate(int64_t bit_rate);
+    int64_t BitRate() const;
+    VideoCodec Codec() const;
+    // latest VPS (H.265 only), SPS and PPS seen in the encoder output, without
+    // start codes; false until all of them exist
+    bool ParameterSets(std::vector<uint8_t> &vps, std::vector<uint8_t> &sps, std::vector<uint8_t> &pps) const;
+    // RTSP path, "<stream>" or "<stream>/<rendition>"
+    const std::string &Name() const;
+    const RenditionConfig &Config() const;
+    const StreamConfig &Stream() const;
+    // per stage latency of this rendition; the framed source adds the delivery stage
+    StageLatency &Latency();
+    // busy/idle time of the encode stage, the encoder never blocks on its output
+    ooknn::StageClock &EncodeClock();
+
+private:
+    void InitializeEncoder();
+    void EncodeStep();
+    void EncodeFrameToSend();
+    void ApplyBitRate();
+    int EncodeFrameToPacket(AVCodecContext *, AVFrame *, AVPacket *);
+    void CleanDeque();
+    void CleanUp();
+
+private:
+    StreamConfig stream_;
+    RenditionConfig config_;
+    std::string name_;
+    std::string encoder_;
+    VideoCodec codec_id_;
+    AVPixelFormat encoder_pix_fmt_;
+    AVFormatContext *format_ctx_;
+    AVCodecContext *codec_ctx_;
+    AVCodec *codec_;
+    AVStream *video_stream_;
+    AVPacket *encoding_packet_;
+    std::unique_ptr<FrameConverter> scaler_;
+    std::atomic_bool stop_flag_;
+    std::atomic_bool key_frame_requested_;
+    std::atomic<int64_t> target_bit_rate_;
+    // VBV of the encoder profile relative to its bitrate, kept when the bitrate changes
+    double max_rate_ratio_;
+    double buffer_ratio_;
+    // references to shared captured frames, scaled when they are encoded
+    ooknn::SpscRing<AVFrame *> deque_;
+    // frames waiting for room in a full ring with the Block policy
+    std::vector<AVFrame *> backlog_;
+    ooknn::Clock::duration encode_period_;
+    ooknn::StageClock encode_clock_;
+    ooknn::Strand encode_strand_;
+    CallBackType encode_cb_;
+    std::vector<PacketCallBackType> packet_cbs_;
+    std::vector<NalRange> nal_ranges_;
+    // stage times of frames inside the encoder, matched to packets by pts
+    struct PendingTiming
+    {
+        int64_t pts;
+        FrameTiming frame;
+        int64_t dequeued;
+        int64_t scaled;
+    };
+    std::deque<PendingTiming> pending_timing_;
+    StageLatency latency_;
+    std::vector<uint8_t> sei_;
+    mutable std::mutex parameter_sets_mutex_;
+    std::vector<uint8_t> vps_;
+    std::vector<uint8_t> sps_;
+    std::vector<uint8_t> pps_;
+};
+
+#endif  // __RENDITION_HPP__
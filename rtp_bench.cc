@@ -0,0 +1,163 @@
+// Loopback benchmark of the RTP egress: the packets of a synthetic H.264
+// stream (an IDR of many full size packets, then small P frames) sent per
+// access unit through ooknn::UdpBatch with sendto, sendmmsg and sendmmsg with
+// UDP GSO. Reports system calls and sender CPU time per Mbit.
+//
+//   ./rtp_bench [access units] [packets per IDR] [gop]
+
+#include "udp_batch.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// what MultiFramedRTPSink puts in a full packet: 12 byte header + 1444 payload
+constexpr size_t PACKET_SIZE = 1456;
+
+struct Result
+{
+    const char *name;
+    uint64_t datagrams;
+    uint64_t syscalls;
+    uint64_t bytes;
+    uint64_t received;
+    double seconds;
+    double cpu_seconds;
+};
+
+double ThreadCpuSeconds()
+{
+    struct rusage usage {};
+    getrusage(RUSAGE_THREAD, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// packet sizes of every access unit: each ends in a shorter packet, the RTP marker one
+std::vector<std::vector<size_t>> MakeStream(size_t units, size_t idr_packets, size_t gop)
+{
+    std::vector<std::vector<size_t>> stream(units);
+    for (size_t i = 0; i < units; ++i)
+    {
+        size_t packets = i % gop == 0 ? idr_packets : 1 + idr_packets / 20 + i % 3;
+        stream[i].assign(packets, PACKET_SIZE);
+        stream[i].back() = 200 + (i * 37) % (PACKET_SIZE - 200);
+    }
+    return stream;
+}
+
+Result Run(const char *name, ooknn::UdpBatch::Mode mode, const std::vector<std::vector<size_t>> &stream)
+{
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    int buffer = 32 * 1024 * 1024;
+    setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    bind(receiver, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    getsockname(receiver, reinterpret_cast<struct sockaddr *>(&address), &length);
+    struct timeval timeout {0, 200000};
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> received(0);
+    std::thread drain([&]() {
+        std::vector<uint8_t> data(65536);
+        while (true)
+        {
+            ssize_t n = recv(receiver, data.data(), data.size(), 0);
+            if (n >= 0)
+            {
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (done.load())
+            {
+                break;
+            }
+        }
+    });
+
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_storage destination {};
+    memcpy(&destination, &address, sizeof(address));
+    std::vector<uint8_t> packet(PACKET_SIZE, 0x5a);
+
+    Result r {name, 0, 0, 0, 0, 0, 0};
+    {
+        ooknn::UdpBatch batch(sender, mode);
+        if (mode == ooknn::UdpBatch::GSO && batch.ActiveMode() != ooknn::UdpBatch::GSO)
+        {
+            printf("%-16s UDP GSO is not supported by this kernel, measuring sendmmsg\n", name);
+        }
+        double cpu = ThreadCpuSeconds();
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &unit : stream)
+        {
+            for (size_t size : unit)
+            {
+                batch.Add(destination, packet.data(), size);
+                r.bytes += size;
+            }
+            batch.Flush();
+            // let the receiver keep up, as the frame interval would
+            if (batch.Datagrams() % 512 < unit.size())
+            {
+                std::this_thread::yield();
+            }
+        }
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        r.cpu_seconds = ThreadCpuSeconds() - cpu;
+        r.datagrams = batch.Datagrams();
+        r.syscalls = batch.Syscalls();
+    }
+
+    done.store(true);
+    drain.join();
+    r.received = received.load();
+    close(sender);
+    close(receiver);
+    return r;
+}
+
+void Report(const Result &r)
+{
+    double mbit = static_cast<double>(r.bytes) * 8 / 1e6;
+    printf("%-16s %9llu datagrams %9llu syscalls (%5.1f per call)  %8.1f Mbit/s  sender cpu %7.2f us/Mbit  received %llu\n",
+           r.name,
+           static_cast<unsigned long long>(r.datagrams),
+           static_cast<unsigned long long>(r.syscalls),
+           r.syscalls ? static_cast<double>(r.datagrams) / static_cast<double>(r.syscalls) : 0.0,
+           mbit / r.seconds,
+           r.cpu_seconds * 1e6 / mbit,
+           static_cast<unsigned long long>(r.received));
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    size_t units = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 20000;
+    size_t idr_packets = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 300;
+    size_t gop = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 25;
+    auto stream = MakeStream(units, idr_packets, gop ? gop : 1);
+
+    printf("%zu access units, IDR of %zu packets every %zu\n", units, idr_packets, gop);
+    Report(Run("sendto", ooknn::UdpBatch::SENDTO, stream));
+    Report(Run("sendmmsg", ooknn::UdpBatch::SENDMMSG, stream));
+    Report(Run("sendmmsg+gso", ooknn::UdpBatch::GSO, stream));
+    return 0;
+}
@@ -1,12 +1,17 @@
 #include "rtsp_server.hpp"
+#include "batching_groupsock.hpp"
 #include "sub_session.hpp"
 #include "codec.hpp"
 #include "frame_source.hpp"
+#include "client_source.hpp"
+#include "rendition.hpp"
 
 #include <UsageEnvironment.hh>
 #include <BasicUsageEnvironment.hh>
 #include <GroupsockHelper.hh>
 #include <liveMedia.hh>
+#include <arpa/inet.h>
+#include <unistd.h>
 #include <vector>
 #include <iostream>
 
@@ -16,6 +21,8 @@ RecordRtspServer::RecordRtspServer(unsigned int port)
     , scheduler_(nullptr)
     , env_(nullptr)
     , server_(nullptr)
+    , stats_interval_(0)
+    , stats_task_(nullptr)
 {
 
     OutPacketBuffer::maxSize = 10 * 1024 * 1024;
@@ -27,8 +34,27 @@ RecordRtspServer::RecordRtspServer(unsigned int port)
 RecordRtspServer::~RecordRtspServer()
 {
 
+    env_->taskScheduler().unscheduleDelayedTask(stats_task_);
+
+    // no encoder may call into a framed source once the sources are closed
+    for (const auto &codec : record_coders_)
+    {
+        codec->Stop();
+    }
+
     Medium::close(server_);  // deletes all server media sessions
 
+    for (auto &session : multicast_sessions_)
+    {
+        session.sink->stopPlaying();
+        Medium::close(session.rtcp);  // sends the RTCP BYE through the sink
+        Medium::close(session.sink);
+        Medium::close(session.source);
+        delete session.rtp_groupsock;
+        delete session.rtcp_groupsock;
+    }
+    multicast_sessions_.clear();
+
     // delete all framed sources
     for (const auto &src : video_sources_)
     {
@@ -61,6 +87,48 @@ void RecordRtspServer::AddTranscoder(RecordCodecPtr codec_ptr)
     record_coders_.push_back(codec_ptr);
 }
 
+void RecordRtspServer::SetStatsInterval(unsigned int seconds)
+{
+    stats_interval_ = seconds;
+}
+
+void RecordRtspServer::SetRtpSend(const std::string &mode)
+{
+    BatchingGroupsock::SetMode(mode == "sendto" ? ooknn::UdpBatch::SENDTO : (mode == "sendmmsg" ? ooknn::UdpBatch::SENDMMSG : ooknn::UdpBatch::GSO));
+}
+
+void RecordRtspServer::ReportStats0(void *clientData)
+{
+    static_cast<RecordRtspServer *>(clientData)->ReportStats();
+}
+
+void RecordRtspServer::ReportStats()
+{
+    for (const auto &transcoder : record_coders_)
+    {
+        if (transcoder->Config().skip_static)
+        {
+            std::cout << transcoder->Name() << ": " << transcoder->FramesSkipped() << " of " << transcoder->FramesFiltered() << " frames skipped as static" << std::endl;
+        }
+        std::cout << transcoder->Name() << ": " << transcoder->StageSummary() << std::endl;
+        if (auto recorder = transcoder->Recorder())
+        {
+            std::cout << transcoder->Name() << ": " << recorder->Summary() << std::endl;
+        }
+        for (const auto &rendition : transcoder->Renditions())
+        {
+            std::cout << rendition->Name() << ": " << rendition->Latency().Summary() << std::endl;
+        }
+    }
+    for (const auto &source : video_sources_)
+    {
+        std::cout << source->Name() << ": " << source->Summary() << std::endl;
+        std::cout << source->Name() << ": " << source->PacketizeClock().Summary() << std::endl;
+    }
+    std::cout << BatchingGroupsock::Summary() << std::endl;
+    stats_task_ = env_->taskScheduler().scheduleDelayedTask(static_cast<int64_t>(stats_interval_) * 1000000, ReportStats0, this);
+}
+
 void RecordRtspServer::Run()
 {
 
@@ -72,25 +140,89 @@ void RecordRtspServer::Run()
 
     for (auto &transcoder : record_coders_)
     {
-        AddMediaSession(transcoder, transcoder->Name(), "stream description");
+        const auto &renditions = transcoder->Renditions();
+        for (size_t i = 0; i < renditions.size(); ++i)
+        {
+            AddMediaSession(renditions[i].get(), static_cast<unsigned int>(i), "stream description");
+        }
+        std::cout << "Starting to capture and encode video from the camera: " << transcoder->RtspUrl() << std::endl;
+        transcoder->Start();
+    }
+
+    if (stats_interval_)
+    {
+        stats_task_ = env_->taskScheduler().scheduleDelayedTask(static_cast<int64_t>(stats_interval_) * 1000000, ReportStats0, this);
     }
 
     env_->taskScheduler().doEventLoop(&stop_);  // do not return
 }
 
-void RecordRtspServer::AddMediaSession(RecordCodec *transcoder, const std::string &streamName, const std::string &streamDesc)
+void RecordRtspServer::AddMediaSession(Rendition *rendition, unsigned int index, const std::string &streamDesc)
 {
 
     assert(OutPacketBuffer::maxSize > 5 * 1024 * 1024);
 
-    std::cout << "Adding media session for camera: " << transcoder->Name() << std::endl;
-    auto framedSource = RecordFrameSource::createNew(*env_, transcoder);
+    const auto &streamName = rendition->Name();
+    std::cout << "Adding media session for camera: " << streamName << std::endl;
+    auto framedSource = RecordFrameSource::createNew(*env_, rendition);
     video_sources_.push_back(framedSource);
-    auto replicator = StreamReplicator::createNew(*env_, framedSource, False);
-    auto sms = ServerMediaSession::createNew(*env_, streamName.c_str(), "stream information", streamDesc.c_str(), False, "a=fmtp:96\n");
-    sms->addSubsession(RecordServerMediaSubsession::createNew(*env_, replicator, estimatedBitrate));
+    bool multicast = rendition->Stream().transport == "multicast";
+    // a multicast session is announced as source specific
+    auto sms = ServerMediaSession::createNew(*env_, streamName.c_str(), "stream information", streamDesc.c_str(), multicast, "a=fmtp:96\n");
+    // kbps, used by live555 to size the RTCP bandwidth of the session
+    auto estimatedBitrate = static_cast<size_t>((rendition->Config().bit_rate + 500) / 1000);
+    if (multicast)
+    {
+        sms->addSubsession(AddMulticastSession(framedSource, rendition, index, estimatedBitrate));
+    }
+    else
+    {
+        sms->addSubsession(RecordServerMediaSubsession::createNew(*env_, framedSource, rendition, estimatedBitrate));
+    }
     server_->addServerMediaSession(sms);
     auto url = server_->rtspURL(sms);
-    std::cout << "Play the stream of the '" << transcoder->Name() << "' camera using the following URL: " << url << std::endl;
+    std::cout << "Play the stream of the '" << streamName << "' camera using the following URL: " << url << std::endl;
     delete[] url;
 }
+
+// The rendition is sent once, to the group, from the moment the server runs;
+// RTSP clients only learn the group and ports from DESCRIBE and join it.
+ServerMediaSubsession *RecordRtspServer::AddMulticastSession(RecordFrameSource *framedSource, Rendition *rendition, unsigned int index, size_t bit_rate)
+{
+    const auto &stream = rendition->Stream();
+    struct sockaddr_storage group {};
+    auto &group4 = reinterpret_cast<struct sockaddr_in &>(group);
+    group4.sin_family = AF_INET;
+    if (stream.multicast_group.empty())
+    {
+        group4.sin_addr.s_addr = chooseRandomIPv4SSMAddress(*env_);
+    }
+    else
+    {
+        // validated when the configuration was loaded
+        inet_pton(AF_INET, stream.multicast_group.c_str(), &group4.sin_addr);
+    }
+    auto rtp_port = static_cast<portNumBits>(stream.multicast_port + 2 * static_cast<int>(index));
+    auto ttl = static_cast<u_int8_t>(stream.multicast_ttl);
+
+    MulticastSession session {};
+    session.rtp_groupsock = new BatchingGroupsock(*env_, group, Port(rtp_port), ttl);
+    session.rtp_groupsock->multicastSendOnly();
+    session.rtcp_groupsock = new BatchingGroupsock(*env_, group, Port(rtp_port + 1), ttl);
+    session.rtcp_groupsock->multicastSendOnly();
+    session.sink = RecordServerMediaSubsession::CreateVideoSink(*env_, session.rtp_groupsock, 96, rendition);
+
+    unsigned char cname[101] = {0};
+    gethostname(reinterpret_cast<char *>(cname), sizeof(cname) - 1);
+    session.rtcp = RTCPInstance::createNew(*env_, session.rtcp_groupsock, static_cast<unsigned>(bit_rate), cname, session.sink, nullptr, True);
+
+    // the one reader of the ring for all multicast viewers
+    session.source = RecordServerMediaSubsession::CreateFramer(*env_, ClientFrameSource::createNew(*env_, framedSource), rendition);
+    session.sink->startPlaying(*session.source, nullptr, nullptr);
+    multicast_sessions_.push_back(session);
+
+    char address[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &group4.sin_addr, address, sizeof(address));
+    std::cout << rendition->Name() << ": multicast to " << address << ":" << rtp_port << ", ttl " << stream.multicast_ttl << std::endl;
+    return PassiveServerMediaSubsession::createNew(*session.sink, session.rtcp);
+}
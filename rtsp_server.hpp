@@ -8,21 +8,30 @@ class UsageEnvironment;
 class TaskScheduler;
 class RTSPServer;
 class RecordCodec;
+class Rendition;
+class RecordFrameSource;
 class FramedSource;
+class Groupsock;
+class RTPSink;
+class RTCPInstance;
+class ServerMediaSubsession;
 
 using RecordCodecPtr = RecordCodec *;
-using FramedSourcePtr = FramedSource *;
+using FramedSourcePtr = RecordFrameSource *;
 
 class RecordRtspServer
 {
 
 public:
-    unsigned int estimatedBitrate = (5000000 + 500) / 1000;
     constexpr static unsigned int DEFAULT_RTSP_PORT_NUMBER = 8554;
     explicit RecordRtspServer(unsigned int port = DEFAULT_RTSP_PORT_NUMBER);
     ~RecordRtspServer();
     void StopServer();
     void AddTranscoder(const RecordCodecPtr);
+    // logs the stage latencies of every rendition this often, 0 disables
+    void SetStatsInterval(unsigned int seconds);
+    // "gso", "sendmmsg" or "sendto", for the RTP sockets created afterwards
+    void SetRtpSend(const std::string &mode);
     void Run();
 
 private:
@@ -36,7 +45,25 @@ private:
     RTSPServer *server_;
     RecordCodecArr record_coders_;
     FramedSourceArr video_sources_;
-    void AddMediaSession(RecordCodec *, const std::string &, const std::string &);
+    // one source specific multicast stream, what every client of it gets
+    struct MulticastSession
+    {
+        Groupsock *rtp_groupsock;
+        Groupsock *rtcp_groupsock;
+        RTPSink *sink;
+        RTCPInstance *rtcp;
+        FramedSource *source;
+    };
+    std::vector<MulticastSession> multicast_sessions_;
+
+    // `index` of the rendition within its stream, for the multicast port
+    void AddMediaSession(Rendition *, unsigned int index, const std::string &);
+    ServerMediaSubsession *AddMulticastSession(RecordFrameSource *, Rendition *, unsigned int index, size_t bit_rate);
+    static void ReportStats0(void *);
+    void ReportStats();
+
+    unsigned int stats_interval_;
+    void *stats_task_;
 };
 
 #endif  // __RTSP_SERVER_HPP__
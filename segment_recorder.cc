@@ -0,0 +1,457 @@
+#include "segment_recorder.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+}
+#endif
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <assert.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <tuple>
+
+// muxer output is gathered into chunks of this size before it reaches the file
+#define RECORD_WRITE_CHUNK (1 << 20)
+#define RECORD_AVIO_BUFFER (64 * 1024)
+// encoded packets waiting for the I/O thread, a few seconds of video
+#define RECORD_QUEUE 512
+// "YYYYmmdd-HHMMSS" in segment file names
+#define SEGMENT_STAMP_LENGTH 15
+
+SegmentRecorder::SegmentRecorder(const StreamConfig &stream,
+                                 const std::string &name,
+                                 const AVCodecParameters *parameters,
+                                 AVRational time_base,
+                                 std::function<void()> request_key_frame)
+    : name_(name)
+    , dir_(stream.record_dir)
+    , format_(stream.record_format)
+    , segment_ticks_(av_rescale_q(static_cast<int64_t>(stream.record_segment_seconds) * AV_TIME_BASE, AV_TIME_BASE_Q, time_base))
+    , retention_seconds_(static_cast<int64_t>(stream.record_retention_minutes) * 60)
+    , max_bytes_(static_cast<uint64_t>(stream.record_max_mb) << 20)
+    , preallocate_(0)
+    , parameters_(avcodec_parameters_alloc())
+    , time_base_(time_base)
+    , request_key_frame_(std::move(request_key_frame))
+    , segment_start_pts_(AV_NOPTS_VALUE)
+    , waiting_key_(true)
+    , key_requested_(false)
+    , queue_(RECORD_QUEUE, ooknn::OverflowPolicy::DropNewest, ooknn::WaitPolicy::Block)
+    , format_ctx_(nullptr)
+    , stream_(nullptr)
+    , fd_(-1)
+    , write_buffer_(nullptr)
+    , buffered_(0)
+    , file_offset_(0)
+    , ts_offset_(AV_NOPTS_VALUE)
+    , write_failed_(false)
+    , total_bytes_(0)
+    , bytes_written_(0)
+    , dropped_(0)
+    , segments_written_(0)
+    , summary_bytes_(0)
+    , summary_time_(std::chrono::steady_clock::now())
+{
+    int statCode = avcodec_parameters_copy(parameters_, parameters);
+    assert(statCode >= 0);
+    // a segment at the configured rate plus some headroom for bursts
+    preallocate_ = static_cast<uint64_t>(std::max<int64_t>(parameters->bit_rate, 0)) / 8 * static_cast<uint64_t>(stream.record_segment_seconds) * 5 / 4;
+
+    statCode = posix_memalign(reinterpret_cast<void **>(&write_buffer_), 4096, RECORD_WRITE_CHUNK);
+    assert(statCode == 0);
+
+    std::error_code error;
+    std::filesystem::create_directories(dir_, error);
+    if (error)
+    {
+        std::cout << name_ << ": cannot create " << dir_ << ": " << error.message() << std::endl;
+    }
+
+    std::cout << name_ << ": recording " << format_ << " segments of " << stream.record_segment_seconds << " s to " << dir_ << std::endl;
+    thread_ = std::thread([this]() { IoLoop(); });
+}
+
+SegmentRecorder::~SegmentRecorder()
+{
+    Stop();
+    avcodec_parameters_free(&parameters_);
+    free(write_buffer_);
+}
+
+void SegmentRecorder::Write(const AVPacket *packet)
+{
+    bool key = packet->flags & AV_PKT_FLAG_KEY;
+    bool due = segment_start_pts_ == AV_NOPTS_VALUE || packet->pts - segment_start_pts_ >= segment_ticks_;
+    if (due && !key && !key_requested_)
+    {
+        // segments begin with a key frame, waiting for the next GOP would stretch this one
+        request_key_frame_();
+        key_requested_ = true;
+    }
+    if (waiting_key_ && !key)
+    {
+        return;
+    }
+
+    Item item {av_packet_clone(packet), due && key};
+    if (!item.packet)
+    {
+        return;
+    }
+    if (item.segment_start)
+    {
+        segment_start_pts_ = packet->pts;
+        key_requested_ = false;
+    }
+    waiting_key_ = false;
+    if (auto rejected = queue_.Push(item))
+    {
+        // the disk is behind, what follows would reference the lost packet
+        av_packet_free(&rejected->packet);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        waiting_key_ = true;
+    }
+}
+
+void SegmentRecorder::Stop()
+{
+    if (!thread_.joinable())
+    {
+        return;
+    }
+    queue_.Close();
+    thread_.join();
+    std::cout << name_ << ": recorded " << segments_written_.load() << " segments, " << (bytes_written_.load() >> 20) << " MiB, "
+              << dropped_.load() << " packets dropped" << std::endl;
+}
+
+void SegmentRecorder::IoLoop()
+{
+    ScanExisting();
+    ApplyRetention();
+    while (true)
+    {
+        // empty once closed and drained
+        Item item = queue_.Pop();
+        if (!item.packet)
+        {
+            break;
+        }
+        if (item.segment_start)
+        {
+            CloseSegment();
+            OpenSegment(item.packet);
+        }
+        if (format_ctx_ && !write_failed_)
+        {
+            AVPacket *p = item.packet;
+            // every segment starts at 0, decode order is what the muxer checks
+            if (ts_offset_ == AV_NOPTS_VALUE)
+            {
+                ts_offset_ = p->dts != AV_NOPTS_VALUE ? p->dts : p->pts;
+            }
+            if (p->pts != AV_NOPTS_VALUE)
+            {
+                p->pts -= ts_offset_;
+            }
+            if (p->dts != AV_NOPTS_VALUE)
+            {
+                p->dts -= ts_offset_;
+            }
+            p->stream_index = 0;
+            av_packet_rescale_ts(p, time_base_, stream_->time_base);
+            if (av_write_frame(format_ctx_, p) < 0)
+            {
+                std::cout << name_ << ": cannot write to " << path_ << ", recording paused until the next segment" << std::endl;
+                write_failed_ = true;
+            }
+        }
+        av_packet_free(&item.packet);
+    }
+    CloseSegment();
+}
+
+void SegmentRecorder::OpenSegment(const AVPacket *first)
+{
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm local {};
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    path_ = dir_ + "/" + name_ + "-" + stamp + "." + format_;
+    // short segments can start within the same second
+    for (int i = 1; access(path_.c_str(), F_OK) == 0; ++i)
+    {
+        path_ = dir_ + "/" + name_ + "-" + stamp + "-" + std::to_string(i) + "." + format_;
+    }
+    write_failed_ = false;
+
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        std::cout << name_ << ": cannot open " << path_ << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    // reserve the blocks up front so the file does not fragment as it grows;
+    // KEEP_SIZE leaves the visible size alone, unsupported file systems just skip it
+    if (preallocate_)
+    {
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocate_));
+    }
+    file_offset_ = 0;
+    buffered_ = 0;
+    ts_offset_ = AV_NOPTS_VALUE;
+
+    int statCode = avformat_alloc_output_context2(&format_ctx_, nullptr, format_ == "ts" ? "mpegts" : "mp4", path_.c_str());
+    assert(statCode >= 0);
+    auto buffer = static_cast<uint8_t *>(av_malloc(RECORD_AVIO_BUFFER));
+    // not seekable: fragmented MP4 and TS are written front to back
+    format_ctx_->pb = avio_alloc_context(buffer, RECORD_AVIO_BUFFER, 1, this, nullptr, WritePacket0, nullptr);
+    format_ctx_->pb->seekable = 0;
+    format_ctx_->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    stream_ = avformat_new_stream(format_ctx_, nullptr);
+    avcodec_parameters_copy(stream_->codecpar, parameters_);
+    stream_->codecpar->codec_tag = 0;
+    stream_->time_base = time_base_;
+    // the encoder repeats the parameter sets in band, the MP4 header needs them before the first packet
+    VideoCodec codec = parameters_->codec_id == AV_CODEC_ID_HEVC ? VideoCodec::H265 : VideoCodec::H264;
+    if (ExtractParameterSets(codec, first->data, static_cast<size_t>(first->size), extradata_) || !extradata_.empty())
+    {
+        stream_->codecpar->extradata = static_cast<uint8_t *>(av_mallocz(extradata_.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        memcpy(stream_->codecpar->extradata, extradata_.data(), extradata_.size());
+        stream_->codecpar->extradata_size = static_cast<int>(extradata_.size());
+    }
+
+    AVDictionary *options = nullptr;
+    if (format_ == "mp4")
+    {
+        // a fragment per GOP, at most a second long, so a crash loses little
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set(&options, "frag_duration", "1000000", 0);
+    }
+    statCode = avformat_write_header(format_ctx_, &options);
+    av_dict_free(&options);
+    if (statCode < 0)
+    {
+        std::cout << name_ << ": cannot start " << path_ << std::endl;
+        write_failed_ = true;
+    }
+
+    std::lock_guard<std::mutex> lock(path_mutex_);
+    current_path_ = path_;
+}
+
+void SegmentRecorder::CloseSegment()
+{
+    if (format_ctx_)
+    {
+        if (!write_failed_)
+        {
+            av_write_trailer(format_ctx_);
+        }
+        avio_flush(format_ctx_->pb);
+        av_freep(&format_ctx_->pb->buffer);
+        avio_context_free(&format_ctx_->pb);
+        avformat_free_context(format_ctx_);
+        format_ctx_ = nullptr;
+        stream_ = nullptr;
+    }
+    if (fd_ < 0)
+    {
+        return;
+    }
+    FlushBuffer();
+    // give back what fallocate reserved beyond the data
+    if (ftruncate(fd_, static_cast<off_t>(file_offset_)) != 0)
+    {
+        std::cout << name_ << ": cannot trim " << path_ << ": " << strerror(errno) << std::endl;
+    }
+    close(fd_);
+    fd_ = -1;
+
+    segments_.push_back(Segment {path_, file_offset_, time(nullptr)});
+    total_bytes_ += file_offset_;
+    segments_written_.fetch_add(1, std::memory_order_relaxed);
+    ApplyRetention();
+}
+
+bool SegmentRecorder::ParseSegmentName(const std::string &file,
+                                       const std::string &name,
+                                       const std::string &format,
+                                       std::string &stamp,
+                                       int &index)
+{
+    std::string prefix = name + "-";
+    std::string ext = "." + format;
+    if (file.size() < prefix.size() + SEGMENT_STAMP_LENGTH + ext.size() ||
+        file.compare(0, prefix.size(), prefix) != 0 ||
+        file.compare(file.size() - ext.size(), ext.size(), ext) != 0)
+    {
+        return false;
+    }
+    std::string rest = file.substr(prefix.size(), file.size() - prefix.size() - ext.size());
+    // YYYYmmdd-HHMMSS
+    for (size_t i = 0; i < SEGMENT_STAMP_LENGTH; ++i)
+    {
+        bool valid = i == 8 ? rest[i] == '-' : isdigit(static_cast<unsigned char>(rest[i])) != 0;
+        if (!valid)
+        {
+            return false;
+        }
+    }
+    index = 0;
+    if (rest.size() > SEGMENT_STAMP_LENGTH)
+    {
+        // "-n" with n from 1, as OpenSegment numbers names taken in the same second
+        std::string suffix = rest.substr(SEGMENT_STAMP_LENGTH);
+        if (suffix.size() < 2 || suffix.size() > 10 || suffix[0] != '-' || suffix[1] == '0' ||
+            !std::all_of(suffix.begin() + 1, suffix.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)) != 0; }))
+        {
+            return false;
+        }
+        index = std::stoi(suffix.substr(1));
+    }
+    stamp = rest.substr(0, SEGMENT_STAMP_LENGTH);
+    return true;
+}
+
+void SegmentRecorder::ScanExisting()
+{
+    // segments of earlier runs count against the retention limits too; only
+    // this recorder's own names, other streams may share the directory
+    std::error_code error;
+    std::vector<std::tuple<std::string, int, std::string>> found;
+    for (const auto &entry : std::filesystem::directory_iterator(dir_, error))
+    {
+        std::string stamp;
+        int index = 0;
+        if (ParseSegmentName(entry.path().filename().string(), name_, format_, stamp, index))
+        {
+            found.emplace_back(stamp, index, entry.path().string());
+        }
+    }
+    // the stamp is the start time, the index orders segments started within one second
+    std::sort(found.begin(), found.end());
+    for (const auto &segment : found)
+    {
+        const std::string &path = std::get<2>(segment);
+        struct stat st {};
+        if (stat(path.c_str(), &st) == 0)
+        {
+            segments_.push_back(Segment {path, static_cast<uint64_t>(st.st_size), st.st_mtime});
+            total_bytes_ += static_cast<uint64_t>(st.st_size);
+        }
+    }
+}
+
+void SegmentRecorder::ApplyRetention()
+{
+    time_t now = time(nullptr);
+    while (!segments_.empty())
+    {
+        const Segment &oldest = segments_.front();
+        bool expired = retention_seconds_ && now - oldest.opened > retention_seconds_;
+        bool over = max_bytes_ && total_bytes_ > max_bytes_;
+        if (!expired && !over)
+        {
+            break;
+        }
+        if (unlink(oldest.path.c_str()) != 0 && errno != ENOENT)
+        {
+            std::cout << name_ << ": cannot remove " << oldest.path << ": " << strerror(errno) << std::endl;
+        }
+        total_bytes_ -= oldest.bytes;
+        segments_.pop_front();
+    }
+}
+
+int SegmentRecorder::WritePacket0(void *opaque, uint8_t *buf, int size)
+{
+    return static_cast<SegmentRecorder *>(opaque)->WritePacket(buf, size);
+}
+
+int SegmentRecorder::WritePacket(const uint8_t *buf, int size)
+{
+    int left = size;
+    while (left > 0)
+    {
+        size_t n = std::min(static_cast<size_t>(left), static_cast<size_t>(RECORD_WRITE_CHUNK) - buffered_);
+        memcpy(write_buffer_ + buffered_, buf, n);
+        buffered_ += n;
+        buf += n;
+        left -= static_cast<int>(n);
+        if (buffered_ == RECORD_WRITE_CHUNK && !FlushBuffer())
+        {
+            return AVERROR(EIO);
+        }
+    }
+    return size;
+}
+
+bool SegmentRecorder::FlushBuffer()
+{
+    if (!buffered_ || fd_ < 0)
+    {
+        return true;
+    }
+    int64_t begin = av_gettime();
+    size_t done = 0;
+    while (done < buffered_)
+    {
+        ssize_t n = write(fd_, write_buffer_ + done, buffered_ - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            std::cout << name_ << ": write to " << path_ << " failed: " << strerror(errno) << std::endl;
+            buffered_ = 0;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    // start writeback right away, dirty pages never pile up into one long flush
+    sync_file_range(fd_, static_cast<off_t>(file_offset_), static_cast<off_t>(buffered_), SYNC_FILE_RANGE_WRITE);
+    write_latency_.Record(av_gettime() - begin);
+    file_offset_ += buffered_;
+    bytes_written_.fetch_add(buffered_, std::memory_order_relaxed);
+    buffered_ = 0;
+    return true;
+}
+
+std::string SegmentRecorder::Summary()
+{
+    auto now = std::chrono::steady_clock::now();
+    uint64_t bytes = bytes_written_.load(std::memory_order_relaxed);
+    double seconds = std::chrono::duration<double>(now - summary_time_).count();
+    double rate = seconds > 0 ? static_cast<double>(bytes - summary_bytes_) / seconds / 1e6 : 0.0;
+    summary_bytes_ = bytes;
+    summary_time_ = now;
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(path_mutex_);
+        path = current_path_;
+    }
+    char line[512];
+    snprintf(line, sizeof(line), "record %s: %.2f MB/s, queue %zu/%zu, write p99/max %.1f/%.1f ms, %llu dropped",
+             path.c_str(), rate, queue_.Size(), queue_.Capacity(), write_latency_.Percentile(0.99) / 1000.0,
+             write_latency_.Max() / 1000.0, static_cast<unsigned long long>(dropped_.load(std::memory_order_relaxed)));
+    write_latency_.Reset();
+    return line;
+}
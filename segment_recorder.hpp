@@ -0,0 +1,141 @@
+#ifndef __SEGMENT_RECORDER_HPP__
+#define __SEGMENT_RECORDER_HPP__
+
+#include "config.hpp"
+#include "latency_stats.hpp"
+#include "nal_splitter.hpp"
+#include "spsc_ring.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/rational.h>
+}
+#endif
+
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVIOContext;
+struct AVPacket;
+struct AVStream;
+
+// Writes the encoded packets of one rendition to disk as time segmented
+// fragmented MP4 or MPEG-TS files, without re-encoding.
+//
+// The encode side only queues a packet reference. Muxing, file writes,
+// rotation and retention all run on the recorder's own I/O thread, so a slow
+// disk never stalls capture or encoding: when the queue is full, packets are
+// dropped up to the next key frame. The muxer writes into a 1 MiB aligned
+// buffer that goes to a preallocated file in whole chunks.
+class SegmentRecorder
+{
+public:
+    // `name` is the file name prefix, `parameters` and `time_base` describe
+    // the encoder output; `request_key_frame` asks the encoder for an IDR
+    // when a segment is due and may be called from Write.
+    SegmentRecorder(const StreamConfig &stream,
+                    const std::string &name,
+                    const AVCodecParameters *parameters,
+                    AVRational time_base,
+                    std::function<void()> request_key_frame);
+    ~SegmentRecorder();
+    SegmentRecorder(const SegmentRecorder &) = delete;
+    SegmentRecorder &operator=(const SegmentRecorder &) = delete;
+
+    // Queues a reference to an encoded packet, never blocks. One producer thread at a time.
+    void Write(const AVPacket *packet);
+    // drains the queue, finishes the open segment and joins the I/O thread
+    void Stop();
+
+    // "record <file>: MB/s, queue depth, write latency, drops" since the previous call
+    std::string Summary();
+
+    // Parses a file name this recorder writes, `<name>-YYYYmmdd-HHMMSS[-n].<format>`,
+    // into its start stamp and collision index (0 without `-n`). False for any
+    // other file, including those of streams whose name starts with `name`.
+    static bool ParseSegmentName(const std::string &file,
+                                 const std::string &name,
+                                 const std::string &format,
+                                 std::string &stamp,
+                                 int &index);
+
+private:
+    struct Item
+    {
+        AVPacket *packet;
+        // first packet of a new segment
+        bool segment_start;
+    };
+
+    struct Segment
+    {
+        std::string path;
+        uint64_t bytes;
+        time_t opened;
+    };
+
+    void IoLoop();
+    void OpenSegment(const AVPacket *first);
+    void CloseSegment();
+    void ScanExisting();
+    void ApplyRetention();
+    static int WritePacket0(void *opaque, uint8_t *buf, int size);
+    int WritePacket(const uint8_t *buf, int size);
+    bool FlushBuffer();
+
+private:
+    std::string name_;
+    std::string dir_;
+    std::string format_;
+    int64_t segment_ticks_;
+    int64_t retention_seconds_;
+    uint64_t max_bytes_;
+    // expected size of a segment, reserved with fallocate when it is opened
+    uint64_t preallocate_;
+    AVCodecParameters *parameters_;
+    AVRational time_base_;
+    std::function<void()> request_key_frame_;
+
+    // producer side, the encode strand
+    int64_t segment_start_pts_;
+    bool waiting_key_;
+    bool key_requested_;
+
+    ooknn::SpscRing<Item> queue_;
+    std::thread thread_;
+
+    // I/O thread
+    AVFormatContext *format_ctx_;
+    AVStream *stream_;
+    int fd_;
+    uint8_t *write_buffer_;
+    size_t buffered_;
+    uint64_t file_offset_;
+    int64_t ts_offset_;
+    bool write_failed_;
+    std::vector<uint8_t> extradata_;
+    std::deque<Segment> segments_;
+    uint64_t total_bytes_;
+    std::string path_;
+
+    // statistics, read by Summary from another thread
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> segments_written_;
+    ooknn::LatencyHistogram write_latency_;
+    std::mutex path_mutex_;
+    std::string current_path_;
+    uint64_t summary_bytes_;
+    std::chrono::steady_clock::time_point summary_time_;
+};
+
+#endif  // __SEGMENT_RECORDER_HPP__
@@ -0,0 +1,66 @@
+// Checks SegmentRecorder::ParseSegmentName, which decides which files in
+// record_dir belong to a recorder and so which ones its retention may delete.
+//
+//   ./segment_recorder_test
+
+#include "segment_recorder.hpp"
+
+#include <cstdio>
+#include <string>
+
+namespace
+{
+
+int failures = 0;
+
+void Expect(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+bool Owns(const std::string &name, const std::string &file)
+{
+    std::string stamp;
+    int index = -1;
+    return SegmentRecorder::ParseSegmentName(file, name, "mp4", stamp, index);
+}
+
+} // namespace
+
+int main()
+{
+    // "cam" is a prefix of "cam-2" and "cam-hd", which record into the same directory
+    Expect(Owns("cam", "cam-20261017-101500.mp4"), "cam owns its segment");
+    Expect(Owns("cam", "cam-20261017-101500-3.mp4"), "cam owns its numbered segment");
+    Expect(!Owns("cam", "cam-2-20261017-101500.mp4"), "cam skips cam-2");
+    Expect(!Owns("cam", "cam-2-20261017-101500-1.mp4"), "cam skips numbered cam-2");
+    Expect(!Owns("cam", "cam-hd-20261017-101500.mp4"), "cam skips cam-hd");
+    Expect(Owns("cam-2", "cam-2-20261017-101500.mp4"), "cam-2 owns its segment");
+    Expect(!Owns("cam-2", "cam-20261017-101500.mp4"), "cam-2 skips cam");
+    Expect(!Owns("cam-2", "cam-20261017-101500-2.mp4"), "cam-2 skips numbered cam");
+
+    // other extensions, malformed stamps and suffixes
+    Expect(!Owns("cam", "cam-20261017-101500.ts"), "other format");
+    Expect(!Owns("cam", "cam-20261017-101500.mp4.part"), "trailing extension");
+    Expect(!Owns("cam", "cam-2026101-101500.mp4"), "short date");
+    Expect(!Owns("cam", "cam-20261017_101500.mp4"), "wrong separator");
+    Expect(!Owns("cam", "cam-20261017-101500-.mp4"), "empty index");
+    Expect(!Owns("cam", "cam-20261017-101500-0.mp4"), "index zero");
+    Expect(!Owns("cam", "cam-20261017-101500-x.mp4"), "index not a number");
+    Expect(!Owns("cam", "cam-20261017-101500-1-2.mp4"), "two indexes");
+
+    std::string stamp;
+    int index = -1;
+    Expect(SegmentRecorder::ParseSegmentName("cam-20261017-101500-12.mp4", "cam", "mp4", stamp, index) &&
+               stamp == "20261017-101500" && index == 12,
+           "stamp and index");
+    Expect(SegmentRecorder::ParseSegmentName("cam-20261017-101500.mp4", "cam", "mp4", stamp, index) && index == 0,
+           "no index");
+
+    std::printf(failures ? "%d failed\n" : "ok\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+#include "shm_frame_ring.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <assert.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#define SHM_PAGE 4096
+#define SHM_LINE_ALIGN 64
+
+ooknn::ShmFrameRing::ShmFrameRing(const std::string &name, void *base, size_t size, bool owner)
+    : name_(name)
+    , base_(static_cast<uint8_t *>(base))
+    , size_(size)
+    , owner_(owner)
+    , header_(static_cast<Header *>(base))
+    , slots_(reinterpret_cast<SlotHeader *>(static_cast<uint8_t *>(base) + FFALIGN(sizeof(Header), sizeof(SlotHeader))))
+    , last_seq_(0)
+    , dropped_(0)
+{
+}
+
+ooknn::ShmFrameRing::~ShmFrameRing()
+{
+    munmap(base_, size_);
+    if (owner_)
+    {
+        shm_unlink(name_.c_str());
+    }
+}
+
+std::unique_ptr<ooknn::ShmFrameRing> ooknn::ShmFrameRing::Create(const std::string &name, int width, int height, const std::string &pix_fmt, int fps, uint32_t slots)
+{
+    AVPixelFormat format = av_get_pix_fmt(pix_fmt.c_str());
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int linesizes[4] = {0};
+    if (!desc || slots < 2 || pix_fmt.size() >= sizeof(Header::pix_fmt) || av_image_fill_linesizes(linesizes, format, width) < 0)
+    {
+        std::cout << name << ": cannot create a frame ring of " << slots << " " << pix_fmt << " slots" << std::endl;
+        return nullptr;
+    }
+
+    // rows and planes are cache line aligned, slots page aligned
+    uint64_t plane_offset[4] = {0};
+    uint64_t slot_size = 0;
+    int planes = av_pix_fmt_count_planes(format);
+    for (int i = 0; i < planes; ++i)
+    {
+        bool chroma = (i == 1 || i == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int rows = chroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        linesizes[i] = FFALIGN(linesizes[i], SHM_LINE_ALIGN);
+        plane_offset[i] = slot_size;
+        slot_size += FFALIGN(static_cast<uint64_t>(linesizes[i]) * static_cast<uint64_t>(rows), SHM_LINE_ALIGN);
+    }
+    slot_size = FFALIGN(slot_size, SHM_PAGE);
+    uint64_t slot_offset = FFALIGN(FFALIGN(sizeof(Header), sizeof(SlotHeader)) + slots * sizeof(SlotHeader), SHM_PAGE);
+    size_t size = static_cast<size_t>(slot_offset + slots * slot_size);
+
+    // a segment left behind by a crashed producer is replaced
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        std::cout << name << ": shm_open failed: " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        std::cout << name << ": cannot map " << size << " bytes: " << strerror(errno) << std::endl;
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    // ftruncate zero fills, which is also the FREE state of every slot
+    std::unique_ptr<ShmFrameRing> ring(new ShmFrameRing(name, base, size, true));
+    Header *h = ring->header_;
+    h->version = VERSION;
+    h->width = width;
+    h->height = height;
+    strncpy(h->pix_fmt, pix_fmt.c_str(), sizeof(h->pix_fmt) - 1);
+    h->fps_num = fps;
+    h->fps_den = 1;
+    h->slots = slots;
+    h->planes = static_cast<uint32_t>(planes);
+    for (int i = 0; i < 4; ++i)
+    {
+        h->linesize[i] = i < planes ? linesizes[i] : 0;
+        h->plane_offset[i] = plane_offset[i];
+    }
+    h->slot_size = slot_size;
+    h->slot_offset = slot_offset;
+    h->magic.store(MAGIC, std::memory_order_release);
+    return ring;
+}
+
+std::unique_ptr<ooknn::ShmFrameRing> ooknn::ShmFrameRing::Open(const std::string &name, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        struct stat st {};
+        if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+        {
+            size_t size = static_cast<size_t>(st.st_size);
+            void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED)
+            {
+                std::cout << name << ": cannot map the frame ring: " << strerror(errno) << std::endl;
+                return nullptr;
+            }
+            std::unique_ptr<ShmFrameRing> ring(new ShmFrameRing(name, base, size, false));
+            const Header *h = ring->header_;
+            if (h->magic.load(std::memory_order_acquire) == MAGIC)
+            {
+                if (h->version != VERSION || h->slot_offset + h->slots * h->slot_size > size)
+                {
+                    std::cout << name << ": incompatible frame ring, version " << h->version << std::endl;
+                    return nullptr;
+                }
+                // there is one consumer, slots still held belong to a previous one
+                for (uint32_t i = 0; i < h->slots; ++i)
+                {
+                    uint32_t reading = READING;
+                    ring->State(static_cast<int>(i)).state.compare_exchange_strong(reading, FREE);
+                }
+                ring->last_seq_ = h->published.load(std::memory_order_acquire);
+                return ring;
+            }
+        }
+        else if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            std::cout << name << ": no frame ring producer" << std::endl;
+            return nullptr;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+int ooknn::ShmFrameRing::BeginWrite()
+{
+    for (uint32_t i = 0; i < header_->slots; ++i)
+    {
+        uint32_t expected = FREE;
+        if (State(static_cast<int>(i)).state.compare_exchange_strong(expected, WRITING, std::memory_order_acquire))
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    // the consumer fell behind: overwrite the oldest frame it has not taken yet
+    int oldest = -1;
+    uint64_t oldest_seq = std::numeric_limits<uint64_t>::max();
+    for (uint32_t i = 0; i < header_->slots; ++i)
+    {
+        auto &s = State(static_cast<int>(i));
+        if (s.state.load(std::memory_order_relaxed) == READY && s.seq.load(std::memory_order_relaxed) < oldest_seq)
+        {
+            oldest = static_cast<int>(i);
+            oldest_seq = s.seq.load(std::memory_order_relaxed);
+        }
+    }
+    uint32_t expected = READY;
+    if (oldest >= 0 && State(oldest).state.compare_exchange_strong(expected, WRITING, std::memory_order_acquire))
+    {
+        return oldest;
+    }
+    return -1;
+}
+
+void ooknn::ShmFrameRing::Publish(int slot, int64_t captured)
+{
+    auto &s = State(slot);
+    uint64_t seq = header_->published.load(std::memory_order_relaxed) + 1;
+    s.seq.store(seq, std::memory_order_relaxed);
+    s.captured.store(captured, std::memory_order_relaxed);
+    s.state.store(READY, std::memory_order_release);
+    header_->published.store(seq, std::memory_order_release);
+}
+
+int ooknn::ShmFrameRing::AcquireLatest(int64_t &captured)
+{
+    // each failed CAS means the producer reclaimed a slot, so this ends
+    for (uint32_t attempt = 0; attempt <= header_->slots; ++attempt)
+    {
+        int newest = -1;
+        uint64_t newest_seq = last_seq_;
+        for (uint32_t i = 0; i < header_->slots; ++i)
+        {
+            auto &s = State(static_cast<int>(i));
+            if (s.state.load(std::memory_order_acquire) == READY && s.seq.load(std::memory_order_relaxed) > newest_seq)
+            {
+                newest = static_cast<int>(i);
+                newest_seq = s.seq.load(std::memory_order_relaxed);
+            }
+        }
+        if (newest < 0)
+        {
+            return -1;
+        }
+
+        uint32_t expected = READY;
+        auto &taken = State(newest);
+        if (!taken.state.compare_exchange_strong(expected, READING, std::memory_order_acquire))
+        {
+            continue;
+        }
+        // possibly refilled since the scan, then it is even newer
+        uint64_t seq = taken.seq.load(std::memory_order_relaxed);
+        captured = taken.captured.load(std::memory_order_relaxed);
+        last_seq_ = seq;
+
+        // skipped frames go back to the producer; a slot is held while its seq
+        // is compared so a frame published meanwhile is never thrown away
+        for (uint32_t i = 0; i < header_->slots; ++i)
+        {
+            auto &s = State(static_cast<int>(i));
+            uint32_t ready = READY;
+            if (static_cast<int>(i) == newest || !s.state.compare_exchange_strong(ready, READING, std::memory_order_acquire))
+            {
+                continue;
+            }
+            if (s.seq.load(std::memory_order_relaxed) < seq)
+            {
+                s.state.store(FREE, std::memory_order_release);
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                s.state.store(READY, std::memory_order_release);
+            }
+        }
+        return newest;
+    }
+    return -1;
+}
+
+void ooknn::ShmFrameRing::Release(int slot)
+{
+    State(slot).state.store(FREE, std::memory_order_release);
+}
+
+uint8_t *ooknn::ShmFrameRing::Slot(int slot) const
+{
+    return base_ + header_->slot_offset + static_cast<uint64_t>(slot) * header_->slot_size;
+}
+
+uint8_t *ooknn::ShmFrameRing::Plane(int slot, int plane) const
+{
+    return Slot(slot) + header_->plane_offset[plane];
+}
+
+const ooknn::ShmFrameRing::Header &ooknn::ShmFrameRing::Info() const
+{
+    return *header_;
+}
+
+int ooknn::ShmFrameRing::SlotOf(const uint8_t *data) const
+{
+    assert(data >= Slot(0) && data < base_ + size_);
+    return static_cast<int>(static_cast<uint64_t>(data - Slot(0)) / header_->slot_size);
+}
+
+uint64_t ooknn::ShmFrameRing::Dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+ooknn::ShmFrameRing::SlotHeader &ooknn::ShmFrameRing::State(int slot) const
+{
+    return slots_[slot];
+}
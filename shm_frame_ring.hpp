@@ -0,0 +1,114 @@
+#ifndef __SHM_FRAME_RING_HPP__
+#define __SHM_FRAME_RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ooknn
+{
+// Fixed size video frames in POSIX shared memory (shm_open), written by one
+// producer process and read by one consumer without copies or locks.
+//
+// Every slot holds one picture and a state word. The producer claims a FREE
+// slot (or the oldest READY one) with a CAS to WRITING, fills it and
+// publishes it as READY. The consumer CASes the newest READY slot to READING,
+// keeps the pixels in place for as long as it needs them, frees older READY
+// slots it skipped and finally stores FREE. A slot is therefore only ever
+// touched by the side that won its CAS.
+//
+// Layout: Header, then `slots` SlotHeader cache lines, then the page aligned
+// slots, slot_size bytes each. Planes inside a slot start at plane_offset[i]
+// with linesize[i] bytes per row.
+class ShmFrameRing
+{
+public:
+    static constexpr uint32_t MAGIC = 0x52464d53;  // "SMFR"
+    static constexpr uint32_t VERSION = 1;
+
+    enum State : uint32_t
+    {
+        FREE = 0,
+        WRITING = 1,
+        READY = 2,
+        READING = 3,
+    };
+
+    struct Header
+    {
+        // written last by the producer, readers wait until it matches MAGIC
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        // av_get_pix_fmt_name of the picture format
+        char pix_fmt[32];
+        int32_t fps_num;
+        int32_t fps_den;
+        uint32_t slots;
+        uint32_t planes;
+        int32_t linesize[4];
+        uint64_t plane_offset[4];
+        uint64_t slot_size;
+        uint64_t slot_offset;
+        // sequence of the last published frame
+        std::atomic<uint64_t> published;
+    };
+
+    struct alignas(64) SlotHeader
+    {
+        std::atomic<uint32_t> state;
+        // the producer may reclaim a READY slot while the consumer looks at it
+        std::atomic<uint64_t> seq;
+        // av_gettime of the capture, set by the producer
+        std::atomic<int64_t> captured;
+    };
+
+    // Producer side: creates (or replaces) the segment `name` for pictures of
+    // `pix_fmt`. Returns nullptr and logs on failure.
+    static std::unique_ptr<ShmFrameRing> Create(const std::string &name, int width, int height, const std::string &pix_fmt, int fps, uint32_t slots);
+    // Consumer side: maps an existing segment, waits up to `timeout_ms` for
+    // the producer to finish initializing it.
+    static std::unique_ptr<ShmFrameRing> Open(const std::string &name, int timeout_ms);
+
+    ~ShmFrameRing();
+    ShmFrameRing(const ShmFrameRing &) = delete;
+    ShmFrameRing &operator=(const ShmFrameRing &) = delete;
+
+    // producer: a slot to fill, -1 if the consumer holds all of them
+    int BeginWrite();
+    void Publish(int slot, int64_t captured);
+
+    // consumer: the newest frame published after the last one acquired, -1 if
+    // there is none; older unread frames are released and counted as dropped
+    int AcquireLatest(int64_t &captured);
+    // safe from any thread of the consumer process
+    void Release(int slot);
+
+    uint8_t *Slot(int slot) const;
+    uint8_t *Plane(int slot, int plane) const;
+    const Header &Info() const;
+    // slot containing `data`, which points into Slot(slot)
+    int SlotOf(const uint8_t *data) const;
+    uint64_t Dropped() const;
+
+private:
+    ShmFrameRing(const std::string &name, void *base, size_t size, bool owner);
+    SlotHeader &State(int slot) const;
+
+private:
+    std::string name_;
+    uint8_t *base_;
+    size_t size_;
+    // the producer unlinks the segment when it goes away
+    bool owner_;
+    Header *header_;
+    SlotHeader *slots_;
+    uint64_t last_seq_;
+    std::atomic<uint64_t> dropped_;
+};
+}  // namespace ooknn
+
+#endif  // __SHM_FRAME_RING_HPP__
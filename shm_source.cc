@@ -0,0 +1,99 @@
+#include "shm_source.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+#endif
+
+#include <iostream>
+#include <assert.h>
+
+// how long a stream waits at startup for its producer to create the ring
+#define SHM_OPEN_TIMEOUT_MS 5000
+
+ShmSource::ShmSource(const StreamConfig &stream)
+    : name_(stream.name)
+    , ring_(ooknn::ShmFrameRing::Open(stream.input, SHM_OPEN_TIMEOUT_MS))
+    , format_(AV_PIX_FMT_NONE)
+{
+    assert(ring_);
+    const auto &info = ring_->Info();
+    format_ = av_get_pix_fmt(info.pix_fmt);
+    assert(format_ != AV_PIX_FMT_NONE);
+
+    // the producer decides the picture, capture_* of the stream are ignored
+    std::cout << "Shared memory frame ring " << stream.input << ": " << info.width << "x" << info.height << " " << info.pix_fmt
+              << ", " << info.slots << " slots of " << info.slot_size << " bytes" << std::endl;
+}
+
+ShmSource::~ShmSource()
+{
+    std::cout << name_ << ": " << ring_->Dropped() << " frames of the ring were never read" << std::endl;
+}
+
+int ShmSource::Read(AVFrame *frame, int64_t &captured)
+{
+    int slot = ring_->AcquireLatest(captured);
+    if (slot < 0)
+    {
+        return 0;
+    }
+
+    const auto &info = ring_->Info();
+    AVBufferRef *buf = av_buffer_create(ring_->Slot(slot), static_cast<int>(info.slot_size), ReleaseSlot, ring_.get(), AV_BUFFER_FLAG_READONLY);
+    if (!buf)
+    {
+        ring_->Release(slot);
+        return AVERROR(ENOMEM);
+    }
+    frame->buf[0] = buf;
+    for (uint32_t i = 0; i < info.planes; ++i)
+    {
+        frame->data[i] = ring_->Plane(slot, static_cast<int>(i));
+        frame->linesize[i] = info.linesize[i];
+    }
+    frame->width = info.width;
+    frame->height = info.height;
+    frame->format = format_;
+    frame->pts = captured;
+    return 1;
+}
+
+void ShmSource::ReleaseSlot(void *opaque, uint8_t *data)
+{
+    auto ring = static_cast<ooknn::ShmFrameRing *>(opaque);
+    ring->Release(ring->SlotOf(data));
+}
+
+int ShmSource::Width() const
+{
+    return ring_->Info().width;
+}
+
+int ShmSource::Height() const
+{
+    return ring_->Info().height;
+}
+
+AVPixelFormat ShmSource::Format() const
+{
+    return format_;
+}
+
+AVRational ShmSource::FrameRate() const
+{
+    return (AVRational) {ring_->Info().fps_num, ring_->Info().fps_den};
+}
+
+AVRational ShmSource::TimeBase() const
+{
+    return (AVRational) {1, 1000000};
+}
+
+AVRational ShmSource::SampleAspectRatio() const
+{
+    return (AVRational) {1, 1};
+}
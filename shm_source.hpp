@@ -0,0 +1,40 @@
+#ifndef __SHM_SOURCE_HPP__
+#define __SHM_SOURCE_HPP__
+
+#include "capture_source.hpp"
+#include "shm_frame_ring.hpp"
+#include <memory>
+
+// Pictures written into a ShmFrameRing by a co-located process, e.g. a
+// renderer. Frames reference the shared memory directly: a slot goes back to
+// the producer when the last AVFrame using it is freed.
+class ShmSource : public CaptureSource
+{
+public:
+    // stream.input is the shm_open name, e.g. "/record-screen"
+    explicit ShmSource(const StreamConfig &stream);
+    ~ShmSource() override;
+    ShmSource(const ShmSource &) = delete;
+    ShmSource &operator=(const ShmSource &) = delete;
+
+    // never blocks: the newest published picture, or 0 if there is none since the last call
+    int Read(AVFrame *frame, int64_t &captured) override;
+
+    int Width() const override;
+    int Height() const override;
+    AVPixelFormat Format() const override;
+    AVRational FrameRate() const override;
+    // pts are the capture wallclock in microseconds
+    AVRational TimeBase() const override;
+    AVRational SampleAspectRatio() const override;
+
+private:
+    static void ReleaseSlot(void *opaque, uint8_t *data);
+
+private:
+    std::string name_;
+    std::unique_ptr<ooknn::ShmFrameRing> ring_;
+    AVPixelFormat format_;
+};
+
+#endif  // __SHM_SOURCE_HPP__
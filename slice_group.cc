@@ -0,0 +1,128 @@
+#include "slice_group.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <iostream>
+
+ooknn::SliceGroup::SliceGroup(size_t threads, std::vector<int> cpus)
+    : job_(nullptr)
+    , count_(0)
+    , generation_(0)
+    , active_(0)
+    , stop_(false)
+    , next_(0)
+    , remaining_(0)
+{
+    for (size_t i = 1; i < threads; ++i)
+    {
+        threads_.emplace_back([this]() { Loop(); });
+        if (cpus.empty())
+        {
+            continue;
+        }
+        // the whole set: a helper pinned to one CPU could share it with the
+        // caller, which runs on any of them, and run its slices serially
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            CPU_SET(cpu, &set);
+        }
+        int error = pthread_setaffinity_np(threads_.back().native_handle(), sizeof(set), &set);
+        if (error)
+        {
+            std::cout << "cannot pin slice thread " << i << ": " << strerror(error) << std::endl;
+        }
+    }
+}
+
+ooknn::SliceGroup::~SliceGroup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (auto &t : threads_)
+    {
+        t.join();
+    }
+}
+
+size_t ooknn::SliceGroup::Threads() const
+{
+    return threads_.size() + 1;
+}
+
+void ooknn::SliceGroup::Run(size_t count, const std::function<void(size_t)> &slice)
+{
+    if (threads_.empty() || count < 2)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            slice(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &slice;
+        count_ = count;
+        next_.store(0, std::memory_order_relaxed);
+        remaining_.store(count, std::memory_order_relaxed);
+        ++generation_;
+    }
+    start_.notify_all();
+    Work(slice, count);
+
+    // a helper that is still inside Work could otherwise pick up the next job's index 0 with this job
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return remaining_.load(std::memory_order_acquire) == 0 && active_ == 0; });
+    job_ = nullptr;
+}
+
+void ooknn::SliceGroup::Work(const std::function<void(size_t)> &slice, size_t count)
+{
+    for (size_t i = next_.fetch_add(1, std::memory_order_relaxed); i < count; i = next_.fetch_add(1, std::memory_order_relaxed))
+    {
+        slice(i);
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.notify_one();
+        }
+    }
+}
+
+void ooknn::SliceGroup::Loop()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        start_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+        if (stop_)
+        {
+            return;
+        }
+        seen = generation_;
+        // woke up after the job was finished
+        if (!job_)
+        {
+            continue;
+        }
+        const auto *slice = job_;
+        size_t count = count_;
+        ++active_;
+        lock.unlock();
+        Work(*slice, count);
+        lock.lock();
+        --active_;
+        if (active_ == 0)
+        {
+            done_.notify_one();
+        }
+    }
+}
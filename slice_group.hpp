@@ -0,0 +1,53 @@
+#ifndef __SLICE_GROUP_HPP__
+#define __SLICE_GROUP_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ooknn
+{
+// A few persistent threads that run the slices of one job together with the
+// calling thread, which takes slices as well and returns once all of them
+// are done. Meant for short data parallel work inside a step, such as
+// converting one frame: handing the slices to the WorkerPool and waiting
+// there would hold its workers.
+class SliceGroup
+{
+public:
+    // `threads` including the caller, helpers may run on any of `cpus`
+    explicit SliceGroup(size_t threads, std::vector<int> cpus = {});
+    ~SliceGroup();
+    SliceGroup(const SliceGroup &) = delete;
+    SliceGroup &operator=(const SliceGroup &) = delete;
+
+    // calls slice(i) for every i in [0, count); one caller at a time
+    void Run(size_t count, const std::function<void(size_t)> &slice);
+    size_t Threads() const;
+
+private:
+    void Loop();
+    void Work(const std::function<void(size_t)> &slice, size_t count);
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    // the job, set by Run under mutex_ and cleared once no helper is inside it
+    const std::function<void(size_t)> *job_;
+    size_t count_;
+    uint64_t generation_;
+    // helpers that took the current job
+    size_t active_;
+    bool stop_;
+    std::atomic<size_t> next_;
+    std::atomic<size_t> remaining_;
+};
+}  // namespace ooknn
+
+#endif  // __SLICE_GROUP_HPP__
@@ -0,0 +1,376 @@
+#ifndef __SPSC_RING_HPP__
+#define __SPSC_RING_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <assert.h>
+
+namespace ooknn
+{
+// What Push does when the ring is full.
+enum class OverflowPolicy
+{
+    DropOldest,  // evict the oldest queued element to make room
+    DropNewest,  // reject the element being pushed
+    Block,       // wait until the consumer frees a slot
+};
+
+// How a side waits for the other one.
+enum class WaitPolicy
+{
+    Spin,   // busy wait, lowest latency, burns a core
+    Block,  // spin briefly, then sleep on a condition variable
+};
+
+// Bounded single-producer/single-consumer ring. Elements are stored in
+// atomic slots, so T must be trivially copyable (typically a pointer).
+// Push/TryPush may only be called from one thread and Pop/TryPop from one
+// other thread.
+template <typename T>
+class SpscRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing holds trivially copyable elements only");
+
+public:
+    explicit SpscRing(size_t capacity,
+                      OverflowPolicy overflow = OverflowPolicy::DropOldest,
+                      WaitPolicy wait = WaitPolicy::Block);
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Returns the element that did not make it into the ring, if any: the
+    // evicted one for DropOldest, `t` itself for DropNewest or when closed.
+    std::optional<T> Push(T t);
+    bool TryPush(T t);
+    // Blocks until an element is available; returns T{} once closed and drained.
+    T Pop();
+    std::optional<T> TryPop();
+    // Wakes all waiters; afterwards Push rejects and Pop stops blocking.
+    void Close();
+
+    bool Empty() const;
+    bool Full() const;
+    bool Closed() const;
+    size_t Size() const;
+    size_t Capacity() const;
+    OverflowPolicy Overflow() const;
+    uint64_t Dropped() const;
+
+private:
+    static constexpr size_t kCacheLine = 64;
+    static constexpr int kSpinCount = 256;
+
+    static size_t RoundUpPowerOfTwo(size_t v);
+    static void CpuRelax();
+    bool PopOne(T &out);
+    void Publish(size_t tail, T t);
+    void WaitNotEmpty();
+    void WaitNotFull();
+
+private:
+    // consumer owned
+    alignas(kCacheLine) std::atomic<size_t> head_ {0};
+    // producer owned
+    alignas(kCacheLine) std::atomic<size_t> tail_ {0};
+    // shared, rarely written
+    alignas(kCacheLine) std::atomic<bool> consumer_waiting_ {false};
+    std::atomic<bool> producer_waiting_ {false};
+    std::atomic<bool> closed_ {false};
+    std::atomic<uint64_t> dropped_ {0};
+    std::mutex mu_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+    const size_t capacity_;
+    const size_t mask_;
+    const OverflowPolicy overflow_;
+    const WaitPolicy wait_;
+    std::unique_ptr<std::atomic<T>[]> slots_;
+};
+}  // namespace ooknn
+
+template <typename T>
+ooknn::SpscRing<T>::SpscRing(size_t capacity, OverflowPolicy overflow, WaitPolicy wait)
+    : capacity_(capacity)
+    , mask_(RoundUpPowerOfTwo(capacity) - 1)
+    , overflow_(overflow)
+    , wait_(wait)
+    , slots_(new std::atomic<T>[mask_ + 1])
+{
+    assert(capacity > 0);
+}
+
+template <typename T>
+size_t ooknn::SpscRing<T>::RoundUpPowerOfTwo(size_t v)
+{
+    size_t p = 1;
+    while (p < v)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+template <typename T>
+void ooknn::SpscRing<T>::CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+template <typename T>
+bool ooknn::SpscRing<T>::Empty() const
+{
+    return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+bool ooknn::SpscRing<T>::Full() const
+{
+    return Size() >= capacity_;
+}
+
+template <typename T>
+bool ooknn::SpscRing<T>::Closed() const
+{
+    return closed_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+size_t ooknn::SpscRing<T>::Size() const
+{
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+template <typename T>
+size_t ooknn::SpscRing<T>::Capacity() const
+{
+    return capacity_;
+}
+
+template <typename T>
+ooknn::OverflowPolicy ooknn::SpscRing<T>::Overflow() const
+{
+    return overflow_;
+}
+
+template <typename T>
+uint64_t ooknn::SpscRing<T>::Dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void ooknn::SpscRing<T>::Publish(size_t tail, T t)
+{
+    slots_[tail & mask_].store(t, std::memory_order_relaxed);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    // pairs with the fence in WaitNotEmpty, either we see the waiter or it sees the new tail
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        not_empty_.notify_one();
+    }
+}
+
+template <typename T>
+bool ooknn::SpscRing<T>::TryPush(T t)
+{
+    if (closed_.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= capacity_)
+    {
+        return false;
+    }
+    Publish(tail, t);
+    return true;
+}
+
+template <typename T>
+std::optional<T> ooknn::SpscRing<T>::Push(T t)
+{
+    if (closed_.load(std::memory_order_acquire))
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return t;
+    }
+
+    std::optional<T> rejected;
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    if (tail - head >= capacity_)
+    {
+        switch (overflow_)
+        {
+            case OverflowPolicy::DropNewest:
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return t;
+            case OverflowPolicy::Block:
+                WaitNotFull();
+                if (closed_.load(std::memory_order_acquire))
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return t;
+                }
+                break;
+            case OverflowPolicy::DropOldest:
+                // race the consumer for the oldest slot; if it wins, there is room anyway
+                while (tail - head >= capacity_)
+                {
+                    T oldest = slots_[head & mask_].load(std::memory_order_relaxed);
+                    if (head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                    {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        rejected = oldest;
+                        break;
+                    }
+                }
+                break;
+        }
+    }
+
+    Publish(tail, t);
+    return rejected;
+}
+
+template <typename T>
+bool ooknn::SpscRing<T>::PopOne(T &out)
+{
+    size_t head = head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out = slots_[head & mask_].load(std::memory_order_relaxed);
+        if (overflow_ != OverflowPolicy::DropOldest)
+        {
+            head_.store(head + 1, std::memory_order_release);
+            break;
+        }
+        // the producer may evict the same slot, only the CAS winner owns it
+        if (head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    if (overflow_ == OverflowPolicy::Block)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer_waiting_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            not_full_.notify_one();
+        }
+    }
+    return true;
+}
+
+template <typename T>
+std::optional<T> ooknn::SpscRing<T>::TryPop()
+{
+    T t;
+    if (PopOne(t))
+    {
+        return t;
+    }
+    return std::nullopt;
+}
+
+template <typename T>
+T ooknn::SpscRing<T>::Pop()
+{
+    T t {};
+    while (!PopOne(t))
+    {
+        if (closed_.load(std::memory_order_acquire))
+        {
+            // drain anything published right before Close
+            return PopOne(t) ? t : T {};
+        }
+        WaitNotEmpty();
+    }
+    return t;
+}
+
+template <typename T>
+void ooknn::SpscRing<T>::WaitNotEmpty()
+{
+    for (int i = 0; i < kSpinCount; ++i)
+    {
+        if (!Empty() || Closed())
+        {
+            return;
+        }
+        CpuRelax();
+    }
+    if (wait_ == WaitPolicy::Spin)
+    {
+        std::this_thread::yield();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mu_);
+    consumer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    not_empty_.wait(lock, [this]() { return !Empty() || Closed(); });
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+template <typename T>
+void ooknn::SpscRing<T>::WaitNotFull()
+{
+    auto has_room = [this]() { return Size() < capacity_ || Closed(); };
+    for (int i = 0; i < kSpinCount; ++i)
+    {
+        if (has_room())
+        {
+            return;
+        }
+        CpuRelax();
+    }
+    if (wait_ == WaitPolicy::Spin)
+    {
+        while (!has_room())
+        {
+            std::this_thread::yield();
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mu_);
+    producer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    not_full_.wait(lock, has_room);
+    producer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+template <typename T>
+void ooknn::SpscRing<T>::Close()
+{
+    closed_.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(mu_);
+    not_empty_.notify_all();
+    not_full_.notify_all();
+}
+
+#endif  // __SPSC_RING_HPP__
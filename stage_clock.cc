@@ -0,0 +1,84 @@
+#include "stage_clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+ooknn::StageClock::StageClock(std::string name)
+    : name_(std::move(name))
+    , busy_us_(0)
+    , blocked_us_(0)
+    , blocked_since_(0)
+    , steps_(0)
+    , summary_time_(Now())
+{
+}
+
+int64_t ooknn::StageClock::Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ooknn::StageClock::Busy(int64_t us)
+{
+    busy_us_.fetch_add(std::max<int64_t>(us, 0), std::memory_order_relaxed);
+    steps_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ooknn::StageClock::SetBlocked(bool blocked)
+{
+    int64_t since = blocked_since_.load(std::memory_order_relaxed);
+    if (blocked == (since != 0))
+    {
+        return;
+    }
+    int64_t now = Now();
+    if (blocked)
+    {
+        blocked_since_.store(now, std::memory_order_relaxed);
+        return;
+    }
+    // Summary may have moved the start of the span forward meanwhile
+    since = blocked_since_.exchange(0, std::memory_order_relaxed);
+    blocked_us_.fetch_add(now - since, std::memory_order_relaxed);
+}
+
+const std::string &ooknn::StageClock::Name() const
+{
+    return name_;
+}
+
+std::string ooknn::StageClock::Summary()
+{
+    int64_t now = Now();
+    int64_t elapsed = std::max<int64_t>(now - summary_time_, 1);
+    summary_time_ = now;
+
+    int64_t blocked = blocked_us_.exchange(0, std::memory_order_relaxed);
+    // a span still open counts up to now, the rest goes to the next interval
+    int64_t since = blocked_since_.load(std::memory_order_relaxed);
+    if (since != 0 && blocked_since_.compare_exchange_strong(since, now, std::memory_order_relaxed))
+    {
+        blocked += now - since;
+    }
+    int64_t busy = busy_us_.exchange(0, std::memory_order_relaxed);
+    uint64_t steps = steps_.exchange(0, std::memory_order_relaxed);
+
+    double busy_pct = std::min(100.0, 100.0 * static_cast<double>(busy) / static_cast<double>(elapsed));
+    double blocked_pct = std::min(100.0 - busy_pct, 100.0 * static_cast<double>(blocked) / static_cast<double>(elapsed));
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%s busy %.0f%% blocked %.0f%% idle %.0f%%, %.1f steps/s", name_.c_str(), busy_pct, blocked_pct,
+             100.0 - busy_pct - blocked_pct, static_cast<double>(steps) * 1e6 / static_cast<double>(elapsed));
+    return buf;
+}
+
+ooknn::StageStep::StageStep(StageClock &clock)
+    : clock_(clock)
+    , begin_(StageClock::Now())
+{
+}
+
+ooknn::StageStep::~StageStep()
+{
+    clock_.Busy(StageClock::Now() - begin_);
+}
@@ -0,0 +1,61 @@
+#ifndef __STAGE_CLOCK_HPP__
+#define __STAGE_CLOCK_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ooknn
+{
+// Where the wallclock time of one pipeline stage goes: busy running its
+// steps, blocked holding output the next stage has no room for yet, idle
+// otherwise. The stage with the most busy time is the bottleneck, a stage
+// that is mostly blocked waits on the one after it.
+//
+// Steps of a stage are serialized (one strand or thread); Summary may be
+// called from any other thread.
+class StageClock
+{
+public:
+    explicit StageClock(std::string name);
+    StageClock(const StageClock &) = delete;
+    StageClock &operator=(const StageClock &) = delete;
+
+    // a step of the stage ran for `us`
+    void Busy(int64_t us);
+    // the stage starts or stops waiting for room downstream; repeated calls
+    // with the same state are ignored
+    void SetBlocked(bool blocked);
+    const std::string &Name() const;
+    // "<name> busy 41% blocked 3% idle 56%, 15.0 steps/s" since the previous call
+    std::string Summary();
+
+    static int64_t Now();
+
+private:
+    std::string name_;
+    std::atomic<int64_t> busy_us_;
+    std::atomic<int64_t> blocked_us_;
+    // start of the current blocked span, 0 while not blocked
+    std::atomic<int64_t> blocked_since_;
+    std::atomic<uint64_t> steps_;
+    // Summary only
+    int64_t summary_time_;
+};
+
+// Counts the lifetime of a step as busy time of its stage.
+class StageStep
+{
+public:
+    explicit StageStep(StageClock &clock);
+    ~StageStep();
+    StageStep(const StageStep &) = delete;
+    StageStep &operator=(const StageStep &) = delete;
+
+private:
+    StageClock &clock_;
+    int64_t begin_;
+};
+}  // namespace ooknn
+
+#endif  // __STAGE_CLOCK_HPP__
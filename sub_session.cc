@@ -1,22 +1,30 @@
 #include "sub_session.hpp"
-#include <StreamReplicator.hh>
+#include "batching_groupsock.hpp"
+#include "client_source.hpp"
+#include "rendition.hpp"
 #include <H264VideoRTPSink.hh>
 #include <H264VideoStreamDiscreteFramer.hh>
+#include <H265VideoRTPSink.hh>
+#include <H265VideoStreamDiscreteFramer.hh>
 #include <iostream>
 
 RecordServerMediaSubsession *RecordServerMediaSubsession::createNew(UsageEnvironment &env,
-                                                                    StreamReplicator *replicator,
+                                                                    RecordFrameSource *source,
+                                                                    Rendition *rendition,
                                                                     size_t bit_rate)
 {
-    return new RecordServerMediaSubsession(env, replicator, bit_rate);
+    return new RecordServerMediaSubsession(env, source, rendition, bit_rate);
 }
 
 RecordServerMediaSubsession::RecordServerMediaSubsession(UsageEnvironment &env,
-                                                         StreamReplicator *replicator,
+                                                         RecordFrameSource *source,
+                                                         Rendition *rendition,
                                                          size_t bit_rate)
     : OnDemandServerMediaSubsession(env, False)
-    , replicator_(replicator)
+    , source_(source)
+    , rendition_(rendition)
     , bit_rate_(bit_rate)
+    , rate_controller_(rendition)
 {
 
     std::cout << "  estimated bitrate of " << bit_rate_ << " (kbps) is created\n";
@@ -26,13 +34,76 @@ FramedSource *RecordServerMediaSubsession::createNewStreamSource(unsigned client
 {
 
     bit_rate = static_cast<unsigned int>(this->bit_rate_);
-    auto source = replicator_->createStreamReplica();
-    return H264VideoStreamDiscreteFramer::createNew(envir(), source);
+    // a cursor into the rendition's ring, the framer only inspects NAL headers
+    auto source = ClientFrameSource::createNew(envir(), source_);
+    return CreateFramer(envir(), source, rendition_);
+}
+
+FramedSource *RecordServerMediaSubsession::CreateFramer(UsageEnvironment &env, FramedSource *source, Rendition *rendition)
+{
+    if (rendition->Codec() == VideoCodec::H265)
+    {
+        return H265VideoStreamDiscreteFramer::createNew(env, source);
+    }
+    return H264VideoStreamDiscreteFramer::createNew(env, source);
+}
+
+RTPSink *RecordServerMediaSubsession::CreateVideoSink(UsageEnvironment &env, Groupsock *gs, unsigned char payload_type, Rendition *rendition)
+{
+    // with the encoder's parameter sets the SDP carries sprop-parameter-sets
+    // (sprop-vps/sps/pps for H.265) right away
+    std::vector<uint8_t> vps;
+    std::vector<uint8_t> sps;
+    std::vector<uint8_t> pps;
+    bool known = rendition->ParameterSets(vps, sps, pps);
+    if (rendition->Codec() == VideoCodec::H265)
+    {
+        if (known)
+        {
+            return H265VideoRTPSink::createNew(env, gs, payload_type, vps.data(), static_cast<unsigned>(vps.size()), sps.data(), static_cast<unsigned>(sps.size()), pps.data(), static_cast<unsigned>(pps.size()));
+        }
+        return H265VideoRTPSink::createNew(env, gs, payload_type);
+    }
+    if (known)
+    {
+        return H264VideoRTPSink::createNew(env, gs, payload_type, sps.data(), static_cast<unsigned>(sps.size()), pps.data(), static_cast<unsigned>(pps.size()));
+    }
+    return H264VideoRTPSink::createNew(env, gs, payload_type);
 }
 
 RTPSink *RecordServerMediaSubsession::createNewRTPSink(Groupsock *rtpGroupsock,
                                                        unsigned char rtpPayloadTypeIfDynamic,
                                                        FramedSource *inputSource)
 {
-    return H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic);
+    return CreateVideoSink(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic, rendition_);
+}
+
+Groupsock *RecordServerMediaSubsession::createGroupsock(struct sockaddr_storage const &addr, Port port)
+{
+    // same as the default, with a time to live of 255
+    return new BatchingGroupsock(envir(), addr, port, 255);
+}
+
+RTCPInstance *RecordServerMediaSubsession::createRTCP(Groupsock *RTCPgs,
+                                                      unsigned totSessionBW,
+                                                      unsigned char const *cname,
+                                                      RTPSink *sink)
+{
+    auto rtcp = OnDemandServerMediaSubsession::createRTCP(RTCPgs, totSessionBW, cname, sink);
+    if (rtcp && sink)
+    {
+        rate_controller_.AddSink(sink);
+        rtcp->setRRHandler(RateController::OnReceiverReport0, &rate_controller_);
+    }
+    return rtcp;
+}
+
+void RecordServerMediaSubsession::deleteStream(unsigned clientSessionId, void *&streamToken)
+{
+    // the sink goes away with the stream state, its stats must not be read afterwards
+    if (auto state = static_cast<StreamState *>(streamToken))
+    {
+        rate_controller_.RemoveSink(state->rtpSink());
+    }
+    OnDemandServerMediaSubsession::deleteStream(clientSessionId, streamToken);
 }
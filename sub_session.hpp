@@ -1,24 +1,37 @@
 #ifndef __SUB_SESSION_HPP__
 #define __SUB_SESSION_HPP__
 
+#include "rate_controller.hpp"
 #include <OnDemandServerMediaSubsession.hh>
 
-class StreamReplicator;
+class RecordFrameSource;
 class FramedSource;
 class RTPSink;
+class Rendition;
 
 class RecordServerMediaSubsession final : public OnDemandServerMediaSubsession
 {
 
 public:
-    static RecordServerMediaSubsession *createNew(UsageEnvironment &env, StreamReplicator *replicator, size_t bit_rate = 100);
+    static RecordServerMediaSubsession *createNew(UsageEnvironment &env, RecordFrameSource *source, Rendition *rendition, size_t bit_rate = 100);
+    // RTP sink for the rendition's codec, shared with the multicast sessions
+    static RTPSink *CreateVideoSink(UsageEnvironment &env, Groupsock *gs, unsigned char payload_type, Rendition *rendition);
+    // H.264 or H.265 discrete framer over `source`, as the sink of the rendition expects
+    static FramedSource *CreateFramer(UsageEnvironment &env, FramedSource *source, Rendition *rendition);
+    void deleteStream(unsigned clientSessionId, void *&streamToken) override;
 
 protected:
-    StreamReplicator *replicator_;
+    RecordFrameSource *source_;
+    Rendition *rendition_;
     size_t bit_rate_;
-    RecordServerMediaSubsession(UsageEnvironment &env, StreamReplicator *replicator, size_t);
+    RateController rate_controller_;
+    RecordServerMediaSubsession(UsageEnvironment &env, RecordFrameSource *source, Rendition *rendition, size_t);
     FramedSource *createNewStreamSource(unsigned, unsigned &) override;
     RTPSink *createNewRTPSink(Groupsock *, unsigned char, FramedSource *) override;
+    // RTP and RTCP of every client go through a BatchingGroupsock
+    Groupsock *createGroupsock(struct sockaddr_storage const &addr, Port port) override;
+    // every client's RTCP instance reports to the rate controller of the rendition
+    RTCPInstance *createRTCP(Groupsock *, unsigned, unsigned char const *, RTPSink *) override;
 };
 
 #endif
@@ -0,0 +1,87 @@
+#include "timestamp_sei.hpp"
+#include "nal_splitter.hpp"
+
+#include <string.h>
+
+// user_data_unregistered
+#define SEI_TYPE_USER_DATA_UNREGISTERED 5
+#define TIMESTAMP_SEI_PAYLOAD_SIZE 24
+
+const uint8_t TIMESTAMP_SEI_UUID[16] = {
+    0x6f, 0x6f, 0x6b, 0x6e, 0x6e, 0x2d, 0x72, 0x65, 0x63, 0x2d, 0x63, 0x61, 0x70, 0x74, 0x75, 0x72,
+};
+
+void BuildTimestampSei(VideoCodec codec, int64_t capture_us, std::vector<uint8_t> &nal)
+{
+    uint8_t rbsp[2 + TIMESTAMP_SEI_PAYLOAD_SIZE + 1];
+    size_t n = 0;
+    rbsp[n++] = SEI_TYPE_USER_DATA_UNREGISTERED;
+    rbsp[n++] = TIMESTAMP_SEI_PAYLOAD_SIZE;
+    memcpy(rbsp + n, TIMESTAMP_SEI_UUID, sizeof(TIMESTAMP_SEI_UUID));
+    n += sizeof(TIMESTAMP_SEI_UUID);
+    for (int shift = 56; shift >= 0; shift -= 8)
+    {
+        rbsp[n++] = static_cast<uint8_t>(static_cast<uint64_t>(capture_us) >> shift);
+    }
+    // rbsp_trailing_bits
+    rbsp[n++] = 0x80;
+
+    nal.clear();
+    if (codec == VideoCodec::H265)
+    {
+        // layer 0, temporal id 0 (+1)
+        nal.push_back(H265_NAL_PREFIX_SEI << 1);
+        nal.push_back(0x01);
+    }
+    else
+    {
+        nal.push_back(H264_NAL_SEI);
+    }
+    // emulation prevention: no 00 00 0x (x <= 3) may appear inside a NAL
+    int zeros = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (zeros == 2 && rbsp[i] <= 3)
+        {
+            nal.push_back(0x03);
+            zeros = 0;
+        }
+        nal.push_back(rbsp[i]);
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+}
+
+bool ParseTimestampSei(VideoCodec codec, const uint8_t *nal, size_t size, int64_t &capture_us)
+{
+    size_t header = codec == VideoCodec::H265 ? 2 : 1;
+    if (size <= header || (codec == VideoCodec::H265 ? H265NalTypeOf(nal) != H265_NAL_PREFIX_SEI : H264NalTypeOf(nal) != H264_NAL_SEI))
+    {
+        return false;
+    }
+    // undo emulation prevention
+    uint8_t rbsp[2 + TIMESTAMP_SEI_PAYLOAD_SIZE];
+    size_t n = 0;
+    int zeros = 0;
+    for (size_t i = header; i < size && n < sizeof(rbsp); ++i)
+    {
+        if (zeros == 2 && nal[i] == 0x03)
+        {
+            zeros = 0;
+            continue;
+        }
+        rbsp[n++] = nal[i];
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+    }
+    if (n < sizeof(rbsp) || rbsp[0] != SEI_TYPE_USER_DATA_UNREGISTERED || rbsp[1] != TIMESTAMP_SEI_PAYLOAD_SIZE ||
+        memcmp(rbsp + 2, TIMESTAMP_SEI_UUID, sizeof(TIMESTAMP_SEI_UUID)) != 0)
+    {
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 2 + sizeof(TIMESTAMP_SEI_UUID); i < sizeof(rbsp); ++i)
+    {
+        v = (v << 8) | rbsp[i];
+    }
+    capture_us = static_cast<int64_t>(v);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef __TIMESTAMP_SEI_HPP__
+#define __TIMESTAMP_SEI_HPP__
+
+#include "nal_splitter.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SEI NAL (no start code, an H.265 prefix SEI for H.265) holding one
+// user_data_unregistered message:
+// the 16 byte TIMESTAMP_SEI_UUID followed by the capture wallclock in
+// microseconds since the Unix epoch, 8 bytes big endian. A client that shares
+// the server's clock gets glass-to-glass latency as receive time minus this.
+extern const uint8_t TIMESTAMP_SEI_UUID[16];
+
+void BuildTimestampSei(VideoCodec codec, int64_t capture_us, std::vector<uint8_t> &nal);
+// false if `nal` is not a timestamp SEI built by BuildTimestampSei
+bool ParseTimestampSei(VideoCodec codec, const uint8_t *nal, size_t size, int64_t &capture_us);
+
+#endif  // __TIMESTAMP_SEI_HPP__
@@ -0,0 +1,199 @@
+#include "udp_batch.hpp"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <cstring>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// kernel limits of one GSO send: segments, and payload within one IP packet
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_BYTES (65535 - 40 - 8)
+
+namespace
+{
+
+socklen_t AddressLength(const struct sockaddr_storage &address)
+{
+    return address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+bool SameDestination(const struct sockaddr_storage &a, const struct sockaddr_storage &b)
+{
+    return a.ss_family == b.ss_family && memcmp(&a, &b, AddressLength(a)) == 0;
+}
+
+}  // namespace
+
+ooknn::UdpBatch::UdpBatch(int fd, Mode mode)
+    : fd_(fd)
+    , mode_(mode)
+    , count_(0)
+    , used_(0)
+    , arena_(ARENA_BYTES)
+    , offsets_(MAX_DATAGRAMS)
+    , sizes_(MAX_DATAGRAMS)
+    , destinations_(MAX_DATAGRAMS)
+    , messages_(MAX_DATAGRAMS)
+    , iovecs_(MAX_DATAGRAMS)
+    , message_first_(MAX_DATAGRAMS)
+    , control_(MAX_DATAGRAMS * CMSG_SPACE(sizeof(uint16_t)))
+    , datagrams_(0)
+    , syscalls_(0)
+    , errors_(0)
+{
+    int segment = 0;
+    socklen_t length = sizeof(segment);
+    // kernels before 4.18 would ignore the option and send one huge datagram
+    if (mode_ == GSO && getsockopt(fd_, SOL_UDP, UDP_SEGMENT, &segment, &length) != 0)
+    {
+        mode_ = SENDMMSG;
+    }
+}
+
+bool ooknn::UdpBatch::Add(const struct sockaddr_storage &to, const uint8_t *data, size_t size)
+{
+    bool ok = true;
+    if (count_ == MAX_DATAGRAMS || used_ + size > arena_.size())
+    {
+        ok = Flush();
+    }
+    if (size > arena_.size())
+    {
+        // never from an RTP sink, but do not lose it
+        ++syscalls_;
+        ++datagrams_;
+        return sendto(fd_, data, size, 0, reinterpret_cast<const struct sockaddr *>(&to), AddressLength(to)) >= 0 && ok;
+    }
+
+    memcpy(arena_.data() + used_, data, size);
+    offsets_[count_] = used_;
+    sizes_[count_] = size;
+    destinations_[count_] = to;
+    used_ += size;
+    ++count_;
+    if (mode_ == SENDTO)
+    {
+        ok = Flush() && ok;
+    }
+    return ok;
+}
+
+bool ooknn::UdpBatch::Flush()
+{
+    if (count_ == 0)
+    {
+        return true;
+    }
+    bool ok = mode_ == SENDTO ? SendTo(0) : SendFrom(0);
+    datagrams_ += count_;
+    count_ = 0;
+    used_ = 0;
+    return ok;
+}
+
+// Whether datagram `next` can join the GSO run starting at `run_start`: all
+// segments but the last have the size of the first one.
+bool ooknn::UdpBatch::Mergeable(size_t run_start, size_t next, size_t run_bytes) const
+{
+    size_t segment = sizes_[run_start];
+    return next - run_start < GSO_MAX_SEGMENTS &&
+           sizes_[next - 1] == segment &&
+           sizes_[next] <= segment &&
+           run_bytes + sizes_[next] <= GSO_MAX_BYTES &&
+           SameDestination(destinations_[run_start], destinations_[next]);
+}
+
+bool ooknn::UdpBatch::SendFrom(size_t first)
+{
+    size_t messages = 0;
+    for (size_t i = first; i < count_;)
+    {
+        size_t j = i + 1;
+        size_t bytes = sizes_[i];
+        while (mode_ == GSO && j < count_ && Mergeable(i, j, bytes))
+        {
+            bytes += sizes_[j];
+            ++j;
+        }
+
+        auto &message = messages_[messages].msg_hdr;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &destinations_[i];
+        message.msg_namelen = AddressLength(destinations_[i]);
+        message.msg_iov = &iovecs_[i];
+        message.msg_iovlen = j - i;
+        for (size_t k = i; k < j; ++k)
+        {
+            iovecs_[k].iov_base = arena_.data() + offsets_[k];
+            iovecs_[k].iov_len = sizes_[k];
+        }
+        if (j - i > 1)
+        {
+            uint8_t *control = control_.data() + messages * CMSG_SPACE(sizeof(uint16_t));
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = static_cast<uint16_t>(sizes_[i]);
+            memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+        }
+        message_first_[messages] = i;
+        ++messages;
+        i = j;
+    }
+
+    size_t sent = 0;
+    while (sent < messages)
+    {
+        int n = sendmmsg(fd_, &messages_[sent], static_cast<unsigned int>(messages - sent), 0);
+        ++syscalls_;
+        if (n > 0)
+        {
+            sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (mode_ == GSO && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT))
+        {
+            // the route's device cannot segment, resend one datagram per message
+            mode_ = SENDMMSG;
+            return SendFrom(message_first_[sent]);
+        }
+        if (errno == ENOSYS)
+        {
+            mode_ = SENDTO;
+            return SendTo(message_first_[sent]);
+        }
+        // UDP is lossy anyway, the rest of this batch is dropped like a failed sendto
+        errors_ += count_ - message_first_[sent];
+        return false;
+    }
+    return true;
+}
+
+bool ooknn::UdpBatch::SendTo(size_t first)
+{
+    bool ok = true;
+    for (size_t i = first; i < count_; ++i)
+    {
+        ++syscalls_;
+        if (sendto(fd_, arena_.data() + offsets_[i], sizes_[i], 0, reinterpret_cast<const struct sockaddr *>(&destinations_[i]), AddressLength(destinations_[i])) < 0)
+        {
+            ++errors_;
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,77 @@
+#ifndef __UDP_BATCH_HPP__
+#define __UDP_BATCH_HPP__
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ooknn
+{
+// Collects the UDP datagrams of one socket and sends them with as few system
+// calls as possible: a flush is one sendmmsg, and with UDP GSO (Linux 4.18+)
+// each run of equal sized datagrams to the same destination is a single
+// message that the kernel, or the NIC, cuts into datagrams again.
+//
+// GSO is probed when the batch is created and dropped for good once the
+// kernel refuses a segmented send, sendmmsg falls back to sendto. Not thread
+// safe; datagrams are copied, so the caller may reuse its buffer right away.
+class UdpBatch
+{
+public:
+    enum Mode
+    {
+        SENDTO,    // one syscall per datagram, sent when added
+        SENDMMSG,  // one syscall per flush, one message per datagram
+        GSO,       // one syscall per flush, one message per run of equal sizes
+    };
+    static constexpr size_t MAX_DATAGRAMS = 64;
+    static constexpr size_t ARENA_BYTES = 256 * 1024;
+
+    // `mode` is the most the socket should use, less if the kernel lacks it
+    explicit UdpBatch(int fd, Mode mode = GSO);
+    UdpBatch(const UdpBatch &) = delete;
+    UdpBatch &operator=(const UdpBatch &) = delete;
+
+    // queues a copy, flushing first when the batch is full; false if a send failed
+    bool Add(const struct sockaddr_storage &to, const uint8_t *data, size_t size);
+    // sends everything queued; false if any datagram could not be sent
+    bool Flush();
+    bool Empty() const { return count_ == 0; }
+
+    Mode ActiveMode() const { return mode_; }
+    uint64_t Datagrams() const { return datagrams_; }
+    uint64_t Syscalls() const { return syscalls_; }
+    uint64_t Errors() const { return errors_; }
+
+private:
+    bool SendFrom(size_t first);
+    bool SendTo(size_t first);
+    bool Mergeable(size_t run_start, size_t next, size_t run_bytes) const;
+
+private:
+    int fd_;
+    Mode mode_;
+
+    size_t count_;
+    size_t used_;
+    std::vector<uint8_t> arena_;
+    std::vector<size_t> offsets_;
+    std::vector<size_t> sizes_;
+    std::vector<struct sockaddr_storage> destinations_;
+
+    // one message per datagram at most
+    std::vector<struct mmsghdr> messages_;
+    std::vector<struct iovec> iovecs_;
+    // first datagram of every message, to resume after a refused send
+    std::vector<size_t> message_first_;
+    std::vector<uint8_t> control_;
+
+    uint64_t datagrams_;
+    uint64_t syscalls_;
+    uint64_t errors_;
+};
+}  // namespace ooknn
+
+#endif  // __UDP_BATCH_HPP__
@@ -0,0 +1,333 @@
+#include "worker_pool.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <assert.h>
+
+namespace
+{
+// std heaps are max heaps, "later" on top would be the wrong way round
+struct Later
+{
+    bool operator()(const ooknn::ScheduledTask &a, const ooknn::ScheduledTask &b) const
+    {
+        return a.deadline > b.deadline || (a.deadline == b.deadline && a.seq > b.seq);
+    }
+};
+
+thread_local const ooknn::WorkerPool *current_pool = nullptr;
+thread_local size_t current_queue = 0;
+}  // namespace
+
+ooknn::WorkerPool::WorkerPool(size_t workers, std::vector<int> cpus, std::string name)
+    : name_(std::move(name))
+    , ready_(0)
+    , seq_(0)
+    , next_queue_(0)
+    , stop_(false)
+    , executed_(0)
+    , stolen_(0)
+    , late_(0)
+{
+    if (workers == 0)
+    {
+        workers = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+    }
+    for (size_t i = 0; i < workers; ++i)
+    {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workers; ++i)
+    {
+        threads_.emplace_back([this, i]() { WorkerLoop(i); });
+        if (cpus.empty())
+        {
+            continue;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i % cpus.size()], &set);
+        int error = pthread_setaffinity_np(threads_.back().native_handle(), sizeof(set), &set);
+        if (error)
+        {
+            std::cout << name_ << ": cannot pin worker " << i << " to CPU " << cpus[i % cpus.size()] << ": " << strerror(error) << std::endl;
+        }
+    }
+    std::cout << name_ << " started with " << workers << " workers" << (cpus.empty() ? "" : ", pinned") << std::endl;
+}
+
+ooknn::WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_.store(true);
+    }
+    wake_.notify_all();
+    for (auto &t : threads_)
+    {
+        t.join();
+    }
+    std::cout << name_ << ": executed " << Executed() << ", stolen " << Stolen() << ", late " << Late() << std::endl;
+}
+
+void ooknn::WorkerPool::Submit(Task task, Clock::time_point deadline)
+{
+    size_t index = current_pool == this ? current_queue : next_queue_.fetch_add(1) % queues_.size();
+    Push(index, ScheduledTask {deadline, seq_.fetch_add(1), std::move(task)});
+    {
+        // a worker checks ready_ under mutex_ before sleeping, so the wakeup cannot be lost
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    wake_.notify_one();
+}
+
+void ooknn::WorkerPool::SubmitAt(Clock::time_point when, Task task, Clock::duration slack)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_.push_back(Timer {when, ScheduledTask {when + slack, seq_.fetch_add(1), std::move(task)}});
+        std::push_heap(timers_.begin(), timers_.end(), [](const Timer &a, const Timer &b) { return a.when > b.when; });
+    }
+    // the earliest timer may have changed, let a sleeper recompute its wait
+    wake_.notify_one();
+}
+
+size_t ooknn::WorkerPool::Workers() const
+{
+    return threads_.size();
+}
+
+uint64_t ooknn::WorkerPool::Executed() const
+{
+    return executed_.load(std::memory_order_relaxed);
+}
+
+uint64_t ooknn::WorkerPool::Stolen() const
+{
+    return stolen_.load(std::memory_order_relaxed);
+}
+
+uint64_t ooknn::WorkerPool::Late() const
+{
+    return late_.load(std::memory_order_relaxed);
+}
+
+void ooknn::WorkerPool::WorkerLoop(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+
+    ScheduledTask task;
+    while (true)
+    {
+        if (PopLocal(index, task) || Steal(index, task))
+        {
+            Execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stop_.load())
+        {
+            break;
+        }
+        if (size_t released = ReleaseTimers(index, Clock::now()))
+        {
+            if (released > 1)
+            {
+                wake_.notify_all();
+            }
+            continue;
+        }
+        if (ready_.load() > 0)
+        {
+            continue;
+        }
+        if (timers_.empty())
+        {
+            wake_.wait(lock);
+        }
+        else
+        {
+            wake_.wait_until(lock, timers_.front().when);
+        }
+    }
+}
+
+void ooknn::WorkerPool::Push(size_t index, ScheduledTask task)
+{
+    auto &queue = *queues_[index];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.heap.push_back(std::move(task));
+        std::push_heap(queue.heap.begin(), queue.heap.end(), Later());
+    }
+    ready_.fetch_add(1);
+}
+
+bool ooknn::WorkerPool::PopLocal(size_t index, ScheduledTask &task)
+{
+    auto &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.heap.empty())
+    {
+        return false;
+    }
+    std::pop_heap(queue.heap.begin(), queue.heap.end(), Later());
+    task = std::move(queue.heap.back());
+    queue.heap.pop_back();
+    ready_.fetch_sub(1);
+    return true;
+}
+
+bool ooknn::WorkerPool::Steal(size_t index, ScheduledTask &task)
+{
+    if (ready_.load() == 0)
+    {
+        return false;
+    }
+
+    // take the most urgent task in the pool rather than the first one found
+    size_t victim = index;
+    Clock::time_point earliest = Clock::time_point::max();
+    for (size_t i = 0; i < queues_.size(); ++i)
+    {
+        if (i == index)
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+        if (!queues_[i]->heap.empty() && queues_[i]->heap.front().deadline < earliest)
+        {
+            earliest = queues_[i]->heap.front().deadline;
+            victim = i;
+        }
+    }
+    if (victim == index || !PopLocal(victim, task))
+    {
+        return false;
+    }
+    stolen_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+size_t ooknn::WorkerPool::ReleaseTimers(size_t index, Clock::time_point now)
+{
+    auto later = [](const Timer &a, const Timer &b) { return a.when > b.when; };
+    size_t released = 0;
+    while (!timers_.empty() && timers_.front().when <= now)
+    {
+        std::pop_heap(timers_.begin(), timers_.end(), later);
+        Push(index, std::move(timers_.back().task));
+        timers_.pop_back();
+        ++released;
+    }
+    return released;
+}
+
+void ooknn::WorkerPool::Execute(ScheduledTask &task)
+{
+    if (Clock::now() > task.deadline)
+    {
+        late_.fetch_add(1, std::memory_order_relaxed);
+    }
+    task.task();
+    task.task = nullptr;
+    executed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+struct ooknn::Strand::State
+{
+    WorkerPool *pool = nullptr;
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<ScheduledTask> heap;
+    uint64_t seq = 0;
+    bool scheduled = false;  // a RunNext is queued in the pool
+    bool running = false;
+    bool closed = false;
+};
+
+ooknn::Strand::Strand(WorkerPool &pool)
+    : pool_(pool)
+    , state_(std::make_shared<State>())
+{
+    state_->pool = &pool_;
+}
+
+ooknn::Strand::~Strand()
+{
+    Close();
+}
+
+void ooknn::Strand::Post(Task task, Clock::time_point deadline)
+{
+    Enqueue(state_, std::move(task), deadline);
+}
+
+void ooknn::Strand::PostAt(Clock::time_point when, Task task, Clock::duration slack)
+{
+    pool_.SubmitAt(
+        when, [state = state_, task = std::move(task), deadline = when + slack]() mutable { Enqueue(state, std::move(task), deadline); }, slack);
+}
+
+void ooknn::Strand::Close()
+{
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->closed = true;
+    state_->heap.clear();
+    state_->idle.wait(lock, [this]() { return !state_->running; });
+}
+
+void ooknn::Strand::Enqueue(const std::shared_ptr<State> &state, Task task, Clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (state->closed)
+    {
+        return;
+    }
+    state->heap.push_back(ScheduledTask {deadline, state->seq++, std::move(task)});
+    std::push_heap(state->heap.begin(), state->heap.end(), Later());
+    if (state->scheduled || state->running)
+    {
+        // the running task reschedules the strand when it is done
+        return;
+    }
+    state->scheduled = true;
+    auto urgent = state->heap.front().deadline;
+    lock.unlock();
+    state->pool->Submit([state]() { RunNext(state); }, urgent);
+}
+
+void ooknn::Strand::RunNext(const std::shared_ptr<State> &state)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->scheduled = false;
+    if (state->closed || state->heap.empty())
+    {
+        return;
+    }
+    std::pop_heap(state->heap.begin(), state->heap.end(), Later());
+    Task task = std::move(state->heap.back().task);
+    state->heap.pop_back();
+    state->running = true;
+    lock.unlock();
+
+    task();
+
+    lock.lock();
+    state->running = false;
+    if (state->closed || state->heap.empty())
+    {
+        state->idle.notify_all();
+        return;
+    }
+    // one task per turn, then compete with the other strands again
+    state->scheduled = true;
+    auto urgent = state->heap.front().deadline;
+    lock.unlock();
+    state->pool->Submit([state]() { RunNext(state); }, urgent);
+}
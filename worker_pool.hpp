@@ -0,0 +1,118 @@
+#ifndef __WORKER_POOL_HPP__
+#define __WORKER_POOL_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ooknn
+{
+using Clock = std::chrono::steady_clock;
+using Task = std::function<void()>;
+
+struct ScheduledTask
+{
+    Clock::time_point deadline;
+    uint64_t seq = 0;  // FIFO among equal deadlines
+    Task task;
+};
+
+// Fixed set of threads shared by all streams. Every worker owns a heap of
+// ready tasks ordered by deadline (earliest first); an idle worker steals the
+// most urgent task of the other workers before going to sleep. Tasks must not
+// block for long, a blocked task holds a whole worker.
+class WorkerPool
+{
+public:
+    // 0 workers: one per hardware thread, or one per CPU of `cpus`. With
+    // `cpus`, worker i is pinned to cpus[i % cpus.size()]; `name` labels the log.
+    explicit WorkerPool(size_t workers = 0, std::vector<int> cpus = {}, std::string name = "Worker pool");
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Ready now. Called from a worker the task stays on that worker's heap.
+    void Submit(Task task, Clock::time_point deadline);
+    // Becomes ready at `when`, with a deadline of `when + slack`.
+    void SubmitAt(Clock::time_point when, Task task, Clock::duration slack);
+
+    size_t Workers() const;
+    uint64_t Executed() const;
+    uint64_t Stolen() const;
+    // tasks that started after their deadline
+    uint64_t Late() const;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::vector<ScheduledTask> heap;
+    };
+    struct Timer
+    {
+        Clock::time_point when;
+        ScheduledTask task;
+    };
+
+    void WorkerLoop(size_t index);
+    void Push(size_t index, ScheduledTask task);
+    bool PopLocal(size_t index, ScheduledTask &task);
+    bool Steal(size_t index, ScheduledTask &task);
+    // moves expired timers to the heap of `index`; mutex_ must be held
+    size_t ReleaseTimers(size_t index, Clock::time_point now);
+    void Execute(ScheduledTask &task);
+
+    std::string name_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    // guards timers_ and sleeping; lock it before a Queue mutex, never after
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Timer> timers_;
+    std::atomic<size_t> ready_;
+    std::atomic<uint64_t> seq_;
+    std::atomic<size_t> next_queue_;
+    std::atomic_bool stop_;
+    std::atomic<uint64_t> executed_;
+    std::atomic<uint64_t> stolen_;
+    std::atomic<uint64_t> late_;
+};
+
+// Serializes the tasks of one owner (e.g. the encoder of a stream) on a
+// WorkerPool. Only one task of a strand runs at a time and a strand only
+// offers the pool its most urgent task, so a stream with a deep backlog
+// cannot crowd out the others.
+class Strand
+{
+public:
+    explicit Strand(WorkerPool &pool);
+    ~Strand();
+    Strand(const Strand &) = delete;
+    Strand &operator=(const Strand &) = delete;
+
+    void Post(Task task, Clock::time_point deadline);
+    void PostAt(Clock::time_point when, Task task, Clock::duration slack);
+    // Drops queued tasks and waits for a running one; later posts are ignored.
+    // Must not be called from a task of this strand.
+    void Close();
+
+private:
+    struct State;
+    static void Enqueue(const std::shared_ptr<State> &state, Task task, Clock::time_point deadline);
+    static void RunNext(const std::shared_ptr<State> &state);
+
+    WorkerPool &pool_;
+    // shared with the tasks in flight, so timers may safely outlive the strand
+    std::shared_ptr<State> state_;
+};
+}  // namespace ooknn
+
+#endif  // __WORKER_POOL_HPP__